@@ -0,0 +1,75 @@
+//**************************************************************************
+//
+//		Frame log format
+//
+//		Shared by radiositySolver.cpp (writer) and
+//		frameLogReader.cpp (reader).
+//
+//**************************************************************************
+
+#ifndef FRAMELOG_H
+#define FRAMELOG_H
+
+#include <stdint.h>
+#include <vector>
+
+// file layout:
+//	FrameLogHeader
+//	{ FrameHeader, payload[payloadBytes] } ...
+//
+// payload of a frame is one record per element whose radiosity changed
+// since the previous frame, in file order:
+//	varint	gap		element id - (previous element id + 1)
+//	float	dr, dg, db	change in radiosity
+// the first frame holds every non-zero element, so applying frames in
+// order from zero rebuilds the radiosity of any logged step.
+
+#define FRAMELOG_MAGIC		0x474C4652	// "RFLG"
+#define FRAMELOG_FRAME_MAGIC	0x454D5246	// "FRME"
+#define FRAMELOG_VERSION	1
+#define FRAMELOG_MAX_RECORD	17		// longest record: 5 byte varint + 3 floats
+
+struct FrameLogHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numPatches;
+	uint32_t numElements;
+	uint64_t sceneHash;
+};
+
+struct FrameHeader {
+	uint32_t magic;
+	int32_t  step;			// totalStep after the frame
+	int32_t  shotPatch;		// last patch shot
+	uint32_t numChanged;		// records in payload
+	float 	 dAmbient[3];		// ambient estimate
+	float 	 avgUnshot[3];		// area weighted unshot radiosity (convergence)
+	uint32_t payloadBytes;
+	uint32_t pad;
+};
+
+// append unsigned LEB128
+inline void writeVarint(std::vector<char> &out, uint32_t value) {
+	while (value >= 0x80) {
+		out.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+// read unsigned LEB128, advances 'p'. false if it runs past 'end'
+// or does not fit in 32 bits
+inline bool readVarint(const char* &p, const char* end, uint32_t &value) {
+	value = 0;
+	for (int shift = 0; shift < 35 && p < end; shift += 7) {
+		unsigned char byte = (unsigned char)*p++;
+		if (shift == 28 && byte > 0x0F)
+			return false;
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+//**************************************************************************
+//
+//		Frame log reader
+//
+//		Lists the frames of a log written by radiositySolver, or
+//		rebuilds element radiosities at a given step.
+//
+//		usage:	frameLogReader <log>			list frames
+//			frameLogReader <log> <step> [out.csv]	rebuild step
+//
+//**************************************************************************
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "frameLog.h"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		cout << "usage: " << argv[0] << " <log> [step] [out.csv]" << endl;
+		return 1;
+	}
+
+	ifstream file(argv[1], ios::binary);
+	if (!file) {
+		cout << "Reader::cannot open " << argv[1] << endl;
+		return 1;
+	}
+
+	FrameLogHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || header.magic != FRAMELOG_MAGIC || header.version != FRAMELOG_VERSION) {
+		cout << "Reader::not a frame log" << endl;
+		return 1;
+	}
+
+	bool rebuild = argc > 2;
+	int targetStep = rebuild ? atoi(argv[2]) : 0;
+
+	// radiosity of every element, file order
+	vector<float> radiosity(3 * header.numElements, 0.f);
+	vector<char> payload;
+	int rebuiltStep = -1;
+
+	if (!rebuild)
+		cout << "step\tpatch\tchanged\tunshot r\tunshot g\tunshot b" << endl;
+
+	FrameHeader frame;
+	while (file.read((char*)&frame, sizeof(frame))) {
+		if (frame.magic != FRAMELOG_FRAME_MAGIC || frame.numChanged > header.numElements
+			|| frame.payloadBytes > (uint64_t)frame.numChanged * FRAMELOG_MAX_RECORD) {
+			cout << "Reader::corrupt frame after step " << rebuiltStep << endl;
+			break;
+		}
+		if (rebuild && frame.step > targetStep)
+			break;
+
+		payload.resize(frame.payloadBytes + 1);
+		if (!file.read(&payload[0], frame.payloadBytes))
+			break;		// truncated last frame (solver still writing)
+
+		if (!rebuild) {
+			cout << frame.step << "\t" << frame.shotPatch << "\t" << frame.numChanged << "\t"
+				<< frame.avgUnshot[0] << "\t" << frame.avgUnshot[1] << "\t" << frame.avgUnshot[2] << endl;
+			continue;
+		}
+
+		// apply deltas, every record must stay inside the payload and the scene
+		const char* p = &payload[0];
+		const char* end = p + frame.payloadBytes;
+		uint32_t e_id = 0;
+		uint32_t i = 0;
+		for (; i < frame.numChanged; i++) {
+			uint32_t gap;
+			float delta[3];
+			if (!readVarint(p, end, gap) || gap >= header.numElements - e_id || end - p < (ptrdiff_t)sizeof(delta))
+				break;
+			e_id += gap;
+			memcpy(delta, p, sizeof(delta));
+			p += sizeof(delta);
+
+			radiosity[3 * e_id + 0] += delta[0];
+			radiosity[3 * e_id + 1] += delta[1];
+			radiosity[3 * e_id + 2] += delta[2];
+			e_id++;
+		}
+		if (i < frame.numChanged || p != end) {
+			cout << "Reader::corrupt frame after step " << rebuiltStep << endl;
+			break;
+		}
+		rebuiltStep = frame.step;
+	}
+
+	if (!rebuild)
+		return 0;
+
+	if (rebuiltStep < 0) {
+		cout << "Reader::no frame at or before step " << targetStep << endl;
+		return 1;
+	}
+
+	// write element radiosities
+	ofstream outFile;
+	if (argc > 3)
+		outFile.open(argv[3]);
+	ostream &out = (argc > 3) ? outFile : cout;
+
+	out << "element,r,g,b" << endl;
+	for (uint32_t e_id = 0; e_id < header.numElements; e_id++)
+		out << e_id << "," << radiosity[3 * e_id] << "," << radiosity[3 * e_id + 1] << "," << radiosity[3 * e_id + 2] << endl;
+
+	cerr << "Reader::rebuilt step " << rebuiltStep << endl;
+	return 0;
+}
@@ -0,0 +1,2353 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+//**************************************************************************
+//
+//		Radiosity solver library
+//
+//		Implementation of radiosity.h. No window or GL calls in here.
+//
+//**************************************************************************
+
+#include <fstream>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "radiosity.h"
+#include "frameLog.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+
+//		Helpers		//
+
+// 64-bit FNV-1a hash, chained through 'h'
+static uint64_t hashBytes(const void* data, size_t size, uint64_t h = 14695981039346656037ULL) {
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+// spread the lower 10 bits of x, two zero bits between each
+static uint32_t expandBits(uint32_t x) {
+	x = (x * 0x00010001u) & 0xFF0000FFu;
+	x = (x * 0x00000101u) & 0x0F00F00Fu;
+	x = (x * 0x00000011u) & 0xC30C30C3u;
+	x = (x * 0x00000005u) & 0x49249249u;
+	return x;
+}
+
+// 30-bit Morton code of p inside the box [lo, hi]
+static uint32_t mortonCode(vec3 p, vec3 lo, vec3 hi) {
+	uint32_t q[3];
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = hi[axis] - lo[axis];
+		float t = (extent > 0) ? (p[axis] - lo[axis]) / extent : 0;
+		q[axis] = (uint32_t)std::min(1023.f, std::max(0.f, t * 1024));
+	}
+	return (expandBits(q[0]) << 2) | (expandBits(q[1]) << 1) | expandBits(q[2]);
+}
+
+// size of one arena column, rounded up to a cache line
+static size_t columnBytes(size_t count, size_t size) {
+	return (count * size + 63) & ~(size_t)63;
+}
+
+// take the next column of 'count' items out of the arena
+template <class T>
+static T* carveColumn(char* &cursor, size_t count) {
+	T* column = (T*)cursor;
+	cursor += columnBytes(count, sizeof(T));
+	return column;
+}
+
+// start of the first cache line inside 'arena'
+static char* alignArena(char* arena) {
+	return arena + ((64 - (size_t)arena % 64) % 64);
+}
+
+
+//		Scene		//
+
+bool Scene::load(const std::string &fileName, int extraSubdivision) {
+
+	// patch as it is read from file
+	struct PatchRecord {
+		int 	vertices[4];
+		Color 	emissivity;
+		Color 	reflectance;
+		int 	numelements;	// number of elements per side
+		int 	startelement;	// first element of this patch, in file order
+	};
+	const uint32_t NO_INDEX = 0xFFFFFFFFu;
+
+	int i, j, k;
+	int nverts, vertnum, startvert;
+	int elnum;
+	Vertex* vtemp;
+	std::ifstream infi(fileName.c_str());
+	Vector v1;
+	Vector v2;
+	double length1, length2;
+	int numPatches, numVertices, numElements = 0;
+
+	if (!infi) {
+		cout << "Load::cannot open " << fileName << endl;
+		return false;
+	}
+
+	SceneStore &Store = store;
+
+	// read initial vertices
+	infi >> nverts;
+	vtemp = new Vertex[nverts];
+	for (i = 0; i<nverts; i++) {
+		infi >> vtemp[i].x >> vtemp[i].y >> vtemp[i].z;
+	}
+	numVertices = nverts;
+
+	// read patches
+	infi >> numPatches;
+	vector<PatchRecord> patches(numPatches);
+	for (i = 0; i<numPatches; i++) {
+
+		// Read patch i
+		infi >> patches[i].vertices[0] >> patches[i].vertices[1]
+			>> patches[i].vertices[2] >> patches[i].vertices[3];
+		infi >> patches[i].emissivity.r >> patches[i].emissivity.g
+			>> patches[i].emissivity.b;
+		infi >> patches[i].reflectance.r >> patches[i].reflectance.g
+			>> patches[i].reflectance.b;
+		infi >> patches[i].numelements;
+
+		// **** TEST : divide more **** //
+		patches[i].numelements += extraSubdivision;
+
+		if (printSteps && (patches[i].emissivity.r > 0 || patches[i].emissivity.g > 0 || patches[i].emissivity.b > 0)){
+			cout << "Load::incident light patch " << i << endl;
+		}
+
+		numVertices += (patches[i].numelements + 1) *
+			(patches[i].numelements + 1);
+		patches[i].startelement = numElements;
+		numElements += (patches[i].numelements * patches[i].numelements);
+	}
+
+	// 1. carve every column out of one arena
+
+	size_t arenaSize = 64
+		+ columnBytes(numVertices, sizeof(Vertex))
+		+ columnBytes(4 * numPatches, sizeof(uint32_t)) + 3 * columnBytes(numPatches, sizeof(Color))
+		+ columnBytes(numPatches, sizeof(Vector)) + columnBytes(numPatches, sizeof(double))
+		+ columnBytes(numPatches + 1, sizeof(uint32_t)) + columnBytes(numElements, sizeof(uint32_t))
+		+ columnBytes(4 * numElements, sizeof(uint32_t)) + 2 * columnBytes(numElements, sizeof(Vector))
+		+ columnBytes(numElements, sizeof(double)) + 3 * columnBytes(numElements, sizeof(uint32_t));
+
+	delete[] Store.arena;
+	Store.arena = new char[arenaSize];
+	char* cursor = alignArena(Store.arena);
+
+	Store.numVertices 	= numVertices;
+	Store.vertexPosition 	= carveColumn<Vertex>(cursor, numVertices);
+
+	Store.numPatches 	= numPatches;
+	Store.patchVertices 	= carveColumn<uint32_t>(cursor, 4 * numPatches);
+	Store.patchEmissivity 	= carveColumn<Color>(cursor, numPatches);
+	Store.patchReflectance 	= carveColumn<Color>(cursor, numPatches);
+	Store.patchCenter 	= carveColumn<Vertex>(cursor, numPatches);
+	Store.patchNormal 	= carveColumn<Vector>(cursor, numPatches);
+	Store.patchArea 	= carveColumn<double>(cursor, numPatches);
+	Store.patchElementStart = carveColumn<uint32_t>(cursor, numPatches + 1);
+	Store.patchElements 	= carveColumn<uint32_t>(cursor, numElements);
+
+	Store.numElements 	= numElements;
+	Store.elementVertices 	= carveColumn<uint32_t>(cursor, 4 * numElements);
+	Store.elementCenter 	= carveColumn<Vertex>(cursor, numElements);
+	Store.elementNormal 	= carveColumn<Vector>(cursor, numElements);
+	Store.elementArea 	= carveColumn<double>(cursor, numElements);
+	Store.elementPatch 	= carveColumn<uint32_t>(cursor, numElements);
+	Store.elementOrigId 	= carveColumn<uint32_t>(cursor, numElements);
+	Store.elementIndex 	= carveColumn<uint32_t>(cursor, numElements);
+
+	// 2. patch attributes
+
+	for (i = 0; i<numPatches; i++) {
+
+		Store.patchEmissivity[i] = patches[i].emissivity;
+		Store.patchReflectance[i] = patches[i].reflectance;
+
+		// patch center
+		Store.patchCenter[i].x = (vtemp[patches[i].vertices[0]].x +
+			vtemp[patches[i].vertices[1]].x +
+			vtemp[patches[i].vertices[2]].x +
+			vtemp[patches[i].vertices[3]].x) / 4.0;
+		Store.patchCenter[i].y = (vtemp[patches[i].vertices[0]].y +
+			vtemp[patches[i].vertices[1]].y +
+			vtemp[patches[i].vertices[2]].y +
+			vtemp[patches[i].vertices[3]].y) / 4.0;
+		Store.patchCenter[i].z = (vtemp[patches[i].vertices[0]].z +
+			vtemp[patches[i].vertices[1]].z +
+			vtemp[patches[i].vertices[2]].z +
+			vtemp[patches[i].vertices[3]].z) / 4.0;
+
+		// patch area
+		v1 = vtemp[patches[i].vertices[1]] - vtemp[patches[i].vertices[0]];
+		v2 = vtemp[patches[i].vertices[3]] - vtemp[patches[i].vertices[0]];
+		length1 = sqrt(v1.x*v1.x + v1.y*v1.y + v1.z*v1.z);
+		length2 = sqrt(v2.x*v2.x + v2.y*v2.y + v2.z*v2.z);
+		Store.patchArea[i] = length1*length2;
+		v1.x /= length1;
+		v1.y /= length1;
+		v1.z /= length1;
+		v2.x /= length2;
+		v2.y /= length2;
+		v2.z /= length2;
+		Store.patchNormal[i].x = v1.y*v2.z - v1.z*v2.y;
+		Store.patchNormal[i].y = v2.x*v1.z - v1.x*v2.z;
+		Store.patchNormal[i].z = v1.x*v2.y - v1.y*v2.x;
+	}
+
+	// 3. form vertices and elements in file order
+
+	vector<Vertex> 	 vfile(numVertices);		// vertex position, file order
+	vector<uint32_t> efileVertices(4 * numElements);	// element vertices, file order
+	vector<Vertex> 	 efileCenter(numElements);	// element center, file order
+	vector<uint32_t> efilePatch(numElements);	// element patch, file order
+
+	// Copy original (patch) vertices to beginning of array
+	for (i = 0; i<nverts; i++)
+		vfile[i] = vtemp[i];
+
+	// Form Vertices for new elements
+	vertnum = nverts;
+	elnum = 0;
+	for (i = 0; i<numPatches; i++) {
+		v1 = (vfile[patches[i].vertices[1]] - vfile[patches[i].vertices[0]]) / (float)patches[i].numelements;
+		v2 = (vfile[patches[i].vertices[3]] - vfile[patches[i].vertices[0]]) / (float)patches[i].numelements;
+
+		startvert = vertnum;
+
+		for (j = 0; j<patches[i].numelements + 1; j++) {
+			for (k = 0; k<patches[i].numelements + 1; k++) {
+				// Create new vertex
+				vfile[vertnum] = vfile[patches[i].vertices[0]] + (float)k * v1 + (float)j * v2;
+				vertnum++;
+			}
+		}
+		// Form Elements for new patch
+		for (j = 0; j<patches[i].numelements; j++) {
+			for (k = 0; k<patches[i].numelements; k++) {
+
+				// Set vertices
+				uint32_t *ev = &efileVertices[4 * elnum];
+				ev[0] = startvert + k +
+					j * (patches[i].numelements + 1);
+				ev[1] = startvert + (k + 1) +
+					j * (patches[i].numelements + 1);
+				ev[2] = startvert + (k + 1) +
+					(j + 1) * (patches[i].numelements + 1);
+				ev[3] = startvert + k +
+					(j + 1) * (patches[i].numelements + 1);
+
+				// Set center
+				efileCenter[elnum] = (vfile[ev[0]] + vfile[ev[1]] + vfile[ev[2]] + vfile[ev[3]]) / 4.f;
+				efilePatch[elnum] = i;
+				elnum++;
+			}
+		}
+	}
+
+	// 4. sort elements along a Morton curve of their centers
+	//    (ties keep file order)
+
+	vec3 lo = efileCenter[0], hi = efileCenter[0];
+	for (i = 1; i<numElements; i++) {
+		lo = glm::min(lo, efileCenter[i]);
+		hi = glm::max(hi, efileCenter[i]);
+	}
+	vector< pair<uint32_t, uint32_t> > order(numElements);	// (morton code, file id)
+	for (i = 0; i<numElements; i++)
+		order[i] = make_pair(mortonCode(efileCenter[i], lo, hi), (uint32_t)i);
+	std::sort(order.begin(), order.end());
+
+	// 5. renumber vertices in the order sorted elements first touch them,
+	//    patch corners (not used by any element) go last
+
+	vector<uint32_t> vertexRemap(numVertices, NO_INDEX);
+	uint32_t nextVertex = 0;
+	for (i = 0; i<numElements; i++) {
+		const uint32_t *ev = &efileVertices[4 * order[i].second];
+		for (j = 0; j<4; j++)
+			if (vertexRemap[ev[j]] == NO_INDEX) vertexRemap[ev[j]] = nextVertex++;
+	}
+	for (i = 0; i<numVertices; i++)
+		if (vertexRemap[i] == NO_INDEX) vertexRemap[i] = nextVertex++;
+
+	// 6. fill vertex and element columns in storage order
+
+	for (i = 0; i<numVertices; i++)
+		Store.vertexPosition[vertexRemap[i]] = vfile[i];
+	for (i = 0; i<numPatches; i++)
+		for (j = 0; j<4; j++)
+			Store.patchVertices[4 * i + j] = vertexRemap[patches[i].vertices[j]];
+
+	for (i = 0; i<numElements; i++) {
+		uint32_t origId = order[i].second;
+		uint32_t patch = efilePatch[origId];
+
+		for (j = 0; j<4; j++)
+			Store.elementVertices[4 * i + j] = vertexRemap[efileVertices[4 * origId + j]];
+		Store.elementCenter[i] 		= efileCenter[origId];
+		Store.elementNormal[i] 		= Store.patchNormal[patch];
+		Store.elementArea[i] 		= Store.patchArea[patch] /
+			(patches[patch].numelements * patches[patch].numelements);
+		Store.elementPatch[i] 		= patch;
+		Store.elementOrigId[i] 		= origId;
+		Store.elementIndex[origId] 	= i;
+	}
+
+	// 7. elements of each patch, in storage order
+
+	for (i = 0; i<=numPatches; i++)
+		Store.patchElementStart[i] = 0;
+	for (i = 0; i<numElements; i++)
+		Store.patchElementStart[Store.elementPatch[i] + 1]++;
+	for (i = 0; i<numPatches; i++)
+		Store.patchElementStart[i + 1] += Store.patchElementStart[i];
+	vector<uint32_t> fill(Store.patchElementStart, Store.patchElementStart + numPatches);
+	for (i = 0; i<numElements; i++)
+		Store.patchElements[fill[Store.elementPatch[i]]++] = i;
+
+	delete[] vtemp;
+	infi.close();
+
+	// 8. hash of the scene geometry and materials
+	hash = hashBytes(&Store.numPatches, sizeof(int));
+	hash = hashBytes(&Store.numElements, sizeof(int), hash);
+	hash = hashBytes(Store.patchCenter, Store.numPatches * sizeof(Vertex), hash);
+	hash = hashBytes(Store.patchNormal, Store.numPatches * sizeof(Vector), hash);
+	hash = hashBytes(Store.patchArea, Store.numPatches * sizeof(double), hash);
+	hash = hashBytes(Store.patchEmissivity, Store.numPatches * sizeof(Color), hash);
+	hash = hashBytes(Store.patchReflectance, Store.numPatches * sizeof(Color), hash);
+	hash = hashBytes(Store.elementOrigId, Store.numElements * sizeof(uint32_t), hash);
+	return true;
+}
+
+
+//		Shaft Culling		//
+//
+// sorts every patch pair (i, j) before form factors are computed:
+//	PAIR_OCCLUDED	j is behind i, i is behind j, or a single patch
+//			cuts every corner to corner segment of the two
+//	PAIR_VISIBLE	both face each other and no other patch enters
+//			the shaft (convex hull of the two patches)
+//	PAIR_PARTIAL	anything else, left to the projector
+// shaft tests only ever err towards PAIR_PARTIAL.
+// every patch is still rendered with all its candidates as occluders,
+// so this rarely pays for itself and Solver leaves it off by default.
+
+#define SHAFT_EPS	1e-4f
+
+struct Shaft {
+	vector<vec3> 	normal;		// outward plane normals
+	vector<float> 	offset;		// dot(normal, p) <= offset inside
+	vec3 		lo, hi;		// bounding box
+};
+
+// convex hull of the corners of two quads, as planes
+static void buildShaft(const vec3 a[4], const vec3 b[4], Shaft &shaft) {
+
+	vec3 p[8];
+	for (int m = 0; m < 4; m++) {
+		p[m] = a[m];
+		p[m + 4] = b[m];
+	}
+	shaft.lo = shaft.hi = p[0];
+	for (int m = 1; m < 8; m++) {
+		shaft.lo = glm::min(shaft.lo, p[m]);
+		shaft.hi = glm::max(shaft.hi, p[m]);
+	}
+
+	// every plane through three corners with all corners on one side
+	shaft.normal.clear();
+	shaft.offset.clear();
+	for (int i = 0; i < 8; i++) for (int j = i + 1; j < 8; j++) for (int k = j + 1; k < 8; k++) {
+		vec3 n = cross(p[j] - p[i], p[k] - p[i]);
+		float len = length(n);
+		if (len < 1e-8f) continue;
+		n /= len;
+		float d = dot(n, p[i]);
+
+		int above = 0, below = 0;
+		for (int m = 0; m < 8; m++) {
+			float s = dot(n, p[m]) - d;
+			if (s > SHAFT_EPS) above++;
+			else if (s < -SHAFT_EPS) below++;
+		}
+		if ((above && below) || (!above && !below)) continue;
+		if (above) { n = -n; d = -d; }
+
+		bool duplicate = false;
+		for (size_t q = 0; q < shaft.normal.size() && !duplicate; q++)
+			duplicate = dot(n, shaft.normal[q]) > 1 - 1e-6f && fabs(d - shaft.offset[q]) < SHAFT_EPS;
+		if (!duplicate) {
+			shaft.normal.push_back(n);
+			shaft.offset.push_back(d);
+		}
+	}
+}
+
+// signed distances of 'count' points to the plane of (c, n)
+static void planeSides(const vec3* p, int count, vec3 c, vec3 n, int &above, int &below) {
+	above = below = 0;
+	for (int m = 0; m < count; m++) {
+		float s = dot(n, p[m] - c);
+		if (s > SHAFT_EPS) above++;
+		else if (s < -SHAFT_EPS) below++;
+	}
+}
+
+// does quad 'c' (normal n) enter the shaft
+static bool quadInShaft(const Shaft &shaft, const vec3 a[4], const vec3 b[4], const vec3 c[4], vec3 n) {
+
+	// 1. bounding boxes
+	vec3 lo = c[0], hi = c[0];
+	for (int m = 1; m < 4; m++) {
+		lo = glm::min(lo, c[m]);
+		hi = glm::max(hi, c[m]);
+	}
+	for (int axis = 0; axis < 3; axis++)
+		if (lo[axis] >= shaft.hi[axis] - SHAFT_EPS || hi[axis] <= shaft.lo[axis] + SHAFT_EPS)
+			return false;
+
+	// 2. a shaft plane with the quad outside
+	for (size_t q = 0; q < shaft.normal.size(); q++) {
+		int m = 0;
+		while (m < 4 && dot(shaft.normal[q], c[m]) - shaft.offset[q] >= -SHAFT_EPS) m++;
+		if (m == 4) return false;
+	}
+
+	// 3. the quad's plane with the shaft on one side
+	int above, below, above2, below2;
+	planeSides(a, 4, c[0], n, above, below);
+	planeSides(b, 4, c[0], n, above2, below2);
+	if (below + below2 == 0 || above + above2 == 0)
+		return false;
+	return true;
+}
+
+// bounding volume hierarchy over the patch boxes, so a shaft only
+// looks at the patches near its own box. laid out like the
+// StochasticSolver BVH, the left child follows its parent
+
+#define PATCH_LEAF_SIZE	4
+
+struct PatchNode {
+	vec3 lo, hi;		// bounds
+	int32_t first;		// leaf : first entry in the patch order, inner : right child
+	int32_t count;		// leaf : number of patches, inner : 0 (left child follows)
+};
+
+// node over order[first, first + count), split at the median of the
+// longest axis of the patch centers. returns the node index
+static int buildPatchNode(vector<PatchNode> &nodes, vector<int32_t> &order, const vector<vec3> &corner, int first, int count) {
+
+	int index = (int)nodes.size();
+	nodes.push_back(PatchNode());
+
+	vec3 lo(1e30f), hi(-1e30f), clo(1e30f), chi(-1e30f);
+	for (int i = first; i < first + count; i++) {
+		const vec3* c = &corner[4 * order[i]];
+		vec3 center = (c[0] + c[1] + c[2] + c[3]) * 0.25f;
+		for (int m = 0; m < 4; m++) {
+			lo = glm::min(lo, c[m]);
+			hi = glm::max(hi, c[m]);
+		}
+		clo = glm::min(clo, center);
+		chi = glm::max(chi, center);
+	}
+	nodes[index].lo = lo;
+	nodes[index].hi = hi;
+
+	if (count <= PATCH_LEAF_SIZE) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	vec3 extent = chi - clo;
+	int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	int half = count / 2;
+	std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+		[&](int32_t a, int32_t b) {
+			const vec3* p = &corner[4 * a];
+			const vec3* q = &corner[4 * b];
+			return p[0][axis] + p[2][axis] < q[0][axis] + q[2][axis];
+		});
+
+	buildPatchNode(nodes, order, corner, first, half);
+	int right = buildPatchNode(nodes, order, corner, first + half, count - half);
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+// patches whose box may overlap the box [lo, hi], with the same
+// SHAFT_EPS slack as quadInShaft()
+static void queryPatches(const vector<PatchNode> &nodes, const vector<int32_t> &order, vec3 lo, vec3 hi, vector<int32_t> &found) {
+
+	found.clear();
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top) {
+		const PatchNode &node = nodes[stack[--top]];
+		bool overlaps = true;
+		for (int axis = 0; axis < 3; axis++)
+			if (node.lo[axis] >= hi[axis] - SHAFT_EPS || node.hi[axis] <= lo[axis] + SHAFT_EPS)
+				overlaps = false;
+		if (!overlaps)
+			continue;
+
+		if (node.count) {
+			found.insert(found.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+			continue;
+		}
+		stack[top++] = node.first;
+		stack[top++] = (int)(&node - &nodes[0]) + 1;
+	}
+}
+
+// is x inside quad c (normal n), at least SHAFT_EPS from its edges
+static bool insideQuad(const vec3 c[4], vec3 n, vec3 x) {
+	int sign = 0;
+	for (int m = 0; m < 4; m++) {
+		vec3 edge = c[(m + 1) % 4] - c[m];
+		float s = dot(cross(edge, x - c[m]), n) / length(edge);
+		int side = (s > SHAFT_EPS) ? 1 : (s < -SHAFT_EPS) ? -1 : 0;
+		if (side == 0 || (sign != 0 && side != sign)) return false;
+		sign = side;
+	}
+	return true;
+}
+
+// does quad c (normal n) cut all 16 segments between the corners
+// of a and b. c is convex, so then it blocks every segment between
+// the two patches
+static bool quadBlocksPair(const vec3 a[4], const vec3 b[4], const vec3 c[4], vec3 n) {
+
+	int aAbove, aBelow, bAbove, bBelow;
+	planeSides(a, 4, c[0], n, aAbove, aBelow);
+	planeSides(b, 4, c[0], n, bAbove, bBelow);
+	if (!((aAbove == 4 && bBelow == 4) || (aBelow == 4 && bAbove == 4)))
+		return false;
+
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			float da = dot(n, a[i] - c[0]), db = dot(n, b[j] - c[0]);
+			vec3 x = a[i] + (b[j] - a[i]) * (da / (da - db));
+			if (!insideQuad(c, n, x)) return false;
+		}
+	}
+	return true;
+}
+
+void Scene::classifyPatchPairs(std::vector<unsigned char> &visibility) const {
+	const SceneStore &Store = store;
+	int P = Store.numPatches;
+
+	vector<vec3> corner(4 * P);
+	for (int p_id = 0; p_id < P; p_id++)
+		for (int m = 0; m < 4; m++)
+			corner[4 * p_id + m] = Store.vertexPosition[Store.patchVertices[4 * p_id + m]];
+
+	visibility.assign(P * P, PAIR_OCCLUDED);
+	int count[3] = { 0, 0, 0 };
+	Shaft shaft;
+
+	vector<PatchNode> nodes;
+	vector<int32_t> order(P), nearby;
+	for (int p_id = 0; p_id < P; p_id++)
+		order[p_id] = p_id;
+	nodes.reserve(2 * P / PATCH_LEAF_SIZE + 1);
+	if (P)
+		buildPatchNode(nodes, order, corner, 0, P);
+
+	for (int i = 0; i < P; i++) {
+		const vec3* a = &corner[4 * i];
+		for (int j = i + 1; j < P; j++) {
+			const vec3* b = &corner[4 * j];
+			int pair = PAIR_PARTIAL;
+
+			// 1. facing
+			int bAbove, bBelow, aAbove, aBelow;
+			planeSides(b, 4, a[0], Store.patchNormal[i], bAbove, bBelow);
+			planeSides(a, 4, b[0], Store.patchNormal[j], aAbove, aBelow);
+			bool facing = (bBelow == 0 && aBelow == 0);
+
+			if (bAbove == 0 || aAbove == 0)
+				pair = PAIR_OCCLUDED;
+			else {
+				// 2. other patches in the shaft, from those near its box.
+				//    the planes are only built once a patch is that near
+				vec3 lo = a[0], hi = a[0];
+				for (int m = 0; m < 4; m++) {
+					lo = glm::min(lo, glm::min(a[m], b[m]));
+					hi = glm::max(hi, glm::max(a[m], b[m]));
+				}
+				queryPatches(nodes, order, lo, hi, nearby);
+				bool empty = true, built = false;
+				for (size_t q = 0; q < nearby.size() && pair != PAIR_OCCLUDED; q++) {
+					int k = nearby[q];
+					if (k == i || k == j) continue;
+					const vec3* c = &corner[4 * k];
+					if (!built) {
+						buildShaft(a, b, shaft);
+						built = true;
+					}
+					if (!quadInShaft(shaft, a, b, c, Store.patchNormal[k])) continue;
+					empty = false;
+					if (quadBlocksPair(a, b, c, Store.patchNormal[k]))
+						pair = PAIR_OCCLUDED;
+				}
+				if (empty && facing)
+					pair = PAIR_VISIBLE;
+			}
+
+			visibility[i * P + j] = visibility[j * P + i] = (unsigned char)pair;
+			count[pair] += 2;
+		}
+	}
+
+	if (printSteps)
+		cout << "Visibility::" << P * (P - 1) << " patch pairs: " << count[PAIR_VISIBLE] << " visible, "
+			<< count[PAIR_OCCLUDED] << " occluded, " << count[PAIR_PARTIAL] << " partial" << endl;
+}
+
+// point to polygon form factor (Lambert):
+// F = 1 / 2PI * sum over edges of angle(r_k, r_k+1) * dot(n, unit(r_k x r_k+1))
+double pointFormFactor(const SceneStore &store, const vec3 &center, const vec3 &normal, int element_id) {
+
+	vec3 r[4];
+	for (int k = 0; k < 4; k++)
+		r[k] = normalize(store.vertexPosition[store.elementVertices[4 * element_id + k]] - center);
+
+	double sum = 0;
+	for (int k = 0; k < 4; k++) {
+		vec3 g = cross(r[k], r[(k + 1) % 4]);
+		double len = length(g);
+		if (len < 1e-12) continue;
+		double angle = atan2(len, (double)dot(r[k], r[(k + 1) % 4]));
+		sum += angle * dot(normal, g) / len;
+	}
+	return fabs(sum) / (2 * PI);
+}
+
+
+//		Hemisphere Projector		//
+
+void HemisphereProjector::itemBuffer(const SceneStore &store, const ProjectionFrame &frame, int face, const std::vector<int> &candidates, int32_t* ids) {
+	std::fill(ids, ids + HEMICUBE_SUBDIV * HEMICUBE_SUBDIV, -1);
+	depthBuffer.assign(HEMICUBE_SUBDIV * HEMICUBE_SUBDIV, 1e30f);
+
+	for (size_t i = 0; i < candidates.size(); i++)
+		rasterizeElement(store, frame, candidates[i], ids);
+}
+
+void HemisphereProjector::rasterizeElement(const SceneStore &store, const ProjectionFrame &frame, int element_id, int32_t* ids) {
+
+	// 1. element corners in the local frame
+	vec3 local[4];
+	for (int i = 0; i < 4; i++) {
+		vec3 p = store.vertexPosition[store.elementVertices[4 * element_id + i]] - frame.center;
+		local[i] = vec3(dot(p, frame.u), dot(p, frame.v), dot(p, frame.normal));
+	}
+
+	// 2. clip against the tangent plane of the patch
+	const float eps = 1e-5f;
+	vector<vec3> clipped;
+	for (int i = 0; i < 4; i++) {
+		vec3 a = local[i], b = local[(i + 1) % 4];
+		bool aIn = a.z > eps, bIn = b.z > eps;
+		if (aIn) clipped.push_back(a);
+		if (aIn != bIn) {
+			float t = (eps - a.z) / (b.z - a.z);
+			clipped.push_back(a + (b - a) * t);
+		}
+	}
+	if (clipped.size() < 3) return;
+
+	// 3. project onto the base disk. edges become arcs,
+	//    so split them before projecting
+	vector<float> px, py;
+	for (size_t i = 0; i < clipped.size(); i++) {
+		vec3 a = clipped[i], b = clipped[(i + 1) % clipped.size()];
+		for (int s = 0; s < HEMISPHERE_EDGE_SPLIT; s++) {
+			vec3 q = normalize(a + (b - a) * ((float)s / HEMISPHERE_EDGE_SPLIT));
+			px.push_back((q.x + 1) * 0.5f * HEMICUBE_SUBDIV);
+			py.push_back((q.y + 1) * 0.5f * HEMICUBE_SUBDIV);
+		}
+	}
+
+	// 4. scanline fill with depth test
+	Vector n = store.elementNormal[element_id];
+	vec3 p0 = store.vertexPosition[store.elementVertices[4 * element_id]] - frame.center;
+	double planeDist = dot(p0, n);
+
+	float yMin = py[0], yMax = py[0];
+	for (size_t i = 1; i < py.size(); i++) {
+		yMin = std::min(yMin, py[i]);
+		yMax = std::max(yMax, py[i]);
+	}
+	int y0 = std::max(0, (int)ceil(yMin - 0.5f));
+	int y1 = std::min(HEMICUBE_SUBDIV - 1, (int)floor(yMax - 0.5f));
+
+	vector<float> xs;
+	for (int y = y0; y <= y1; y++) {
+		float sy = y + 0.5f;
+
+		// crossings of this scanline
+		xs.clear();
+		for (size_t i = 0; i < px.size(); i++) {
+			size_t j = (i + 1) % px.size();
+			if ((py[i] <= sy) != (py[j] <= sy))
+				xs.push_back(px[i] + (sy - py[i]) / (py[j] - py[i]) * (px[j] - px[i]));
+		}
+		std::sort(xs.begin(), xs.end());
+
+		for (size_t k = 0; k + 1 < xs.size(); k += 2) {
+			int x0 = std::max(0, (int)ceil(xs[k] - 0.5f));
+			int x1 = std::min(HEMICUBE_SUBDIV - 1, (int)floor(xs[k + 1] - 0.5f));
+			for (int x = x0; x <= x1; x++) {
+				double dx = (x + 0.5) * 2.0 / HEMICUBE_SUBDIV - 1;
+				double dy = sy * 2.0 / HEMICUBE_SUBDIV - 1;
+				double dz2 = 1 - dx*dx - dy*dy;
+				if (dz2 <= 0) continue;
+
+				// distance along the pixel ray to the element plane
+				vec3 dir = frame.u * (float)dx + frame.v * (float)dy + frame.normal * (float)sqrt(dz2);
+				double denom = dot(dir, n);
+				double depth = (fabs(denom) > 1e-8) ? planeDist / denom : length(p0);
+
+				int index = y * HEMICUBE_SUBDIV + x;
+				if (depth > 0 && depth < depthBuffer[index]) {
+					depthBuffer[index] = (float)depth;
+					ids[index] = element_id;
+				}
+			}
+		}
+	}
+}
+
+
+//		Solver		//
+
+// initialize solution : compute initial ambience, init unshot patches
+Solver::Solver(const Scene &scene_) : scene(&scene_), formFactorHash(0),
+	tableFormat(TABLE_DOUBLE), packedTable(0), packedScale(0),
+	totalStep(0), currentPatchID(0), overshooting(false), shaftCulling(false), printSteps(false),
+	checkpointPending(0), checkpointBusy(false), checkpointQuit(false), frameLog(0), frameLogQuit(false) {
+
+	const SceneStore &Store = scene->store;
+
+	// 0. solution columns
+
+	arena = new char[64 + columnBytes(Store.numElements, sizeof(Color))
+		+ columnBytes(Store.numPatches, sizeof(Color)) + columnBytes(Store.numVertices, sizeof(Color))];
+	char* cursor = alignArena(arena);
+	elementRadiosity 	= carveColumn<Color>(cursor, Store.numElements);
+	patchUnshot 		= carveColumn<Color>(cursor, Store.numPatches);
+	vertexColor 		= carveColumn<Color>(cursor, Store.numVertices);
+
+	// 1. compute some factors...
+
+	Color avgPatchRefl(0, 0, 0); // weighted average of the patch reflectives
+	Color sumEmi(0, 0, 0);		 // weighted sum of emission
+
+	double areaSum = 0;
+	for (int id = 0; id < Store.numPatches; id++) {
+
+		avgPatchRefl.r += (Store.patchReflectance[id].r * Store.patchArea[id]);
+		avgPatchRefl.g += (Store.patchReflectance[id].g * Store.patchArea[id]);
+		avgPatchRefl.b += (Store.patchReflectance[id].b * Store.patchArea[id]);
+
+		sumEmi.r += (Store.patchEmissivity[id].r * Store.patchArea[id]);
+		sumEmi.g += (Store.patchEmissivity[id].g * Store.patchArea[id]);
+		sumEmi.b += (Store.patchEmissivity[id].b * Store.patchArea[id]);
+
+		areaSum += Store.patchArea[id];
+	}
+
+	// 2. compute reflection factor R
+
+	avgPatchRefl.r /= areaSum;
+	avgPatchRefl.g /= areaSum;
+	avgPatchRefl.b /= areaSum;
+	// assign final value
+	reflectionFactor.r = 1 / (1 - avgPatchRefl.r);
+	reflectionFactor.g = 1 / (1 - avgPatchRefl.g);
+	reflectionFactor.b = 1 / (1 - avgPatchRefl.b);
+
+	// 3. determine initial ambient from given emission
+
+	ambient.r = reflectionFactor.r * sumEmi.r / areaSum;
+	ambient.g = reflectionFactor.g * sumEmi.g / areaSum;
+	ambient.b = reflectionFactor.b * sumEmi.b / areaSum;
+
+	// 4. initialize look up table
+
+	// patch to element table
+	lookUpTable = new double*[Store.numPatches];
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		lookUpTable[p_id] = new double[Store.numElements];
+		for (int e_id = 0; e_id < Store.numElements; e_id++)
+			lookUpTable[p_id][e_id] = 0;		// initialize value
+	}
+
+	// 5. emitted light only, initial heap & vertex color
+	reset();
+	updateVertexColor(true);
+
+	// 6. checkpoint writer
+	checkpointThread = std::thread(&Solver::checkpointLoop, this);
+}
+
+Solver::~Solver() {
+
+	// let a pending checkpoint write land, then stop the writer
+	{
+		std::lock_guard<std::mutex> lock(checkpointMutex);
+		checkpointQuit = true;
+		checkpointWake.notify_all();
+	}
+	checkpointThread.join();
+	closeFrameLog();
+
+	for (int p_id = 0; p_id < scene->store.numPatches; p_id++)
+		delete[] lookUpTable[p_id];
+	delete[] lookUpTable;
+	delete[] packedTable;
+	delete[] packedScale;
+	delete[] arena;
+}
+
+// hash of the form factor table, in file order
+uint64_t Solver::computeFormFactorHash() const {
+	const SceneStore &Store = scene->store;
+	uint64_t h = 14695981039346656037ULL;
+	vector<double> scratch;
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		const double *row = formFactorRow(p_id, scratch);
+		for (int e_id = 0; e_id < Store.numElements; e_id++)
+			h = hashBytes(&row[Store.elementIndex[e_id]], sizeof(double), h);
+	}
+	return h;
+}
+
+// update priority queue
+void Solver::updatePriorityQueue() {
+	const SceneStore &Store = scene->store;
+
+	// reset priority queue
+	while (!unshotPatchQueue.empty())
+		unshotPatchQueue.pop();
+
+	for (int id = 0; id < Store.numPatches; id++) {
+		UnshotTag unshot(patchUnshot[id], id);
+		unshotPatchQueue.push(unshot);
+	}
+}
+
+// ambient estimate: unshot radiosity still to be spread,
+// scaled by the overall interreflection factor R
+Color Solver::computeAmbient() const {
+	const SceneStore &Store = scene->store;
+
+	double areaSum = 0;					// Sum of all patch area
+	Color rfltWeightedAreaSum(0, 0, 0);	// Sum of all patch area * patch reflectance
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		areaSum += Store.patchArea[p_id];
+
+		rfltWeightedAreaSum.r += Store.patchArea[p_id] * Store.patchReflectance[p_id].r;
+		rfltWeightedAreaSum.g += Store.patchArea[p_id] * Store.patchReflectance[p_id].g;
+		rfltWeightedAreaSum.b += Store.patchArea[p_id] * Store.patchReflectance[p_id].b;
+	}
+	// overall interreflection factor R
+	Color R, rfltAvg;
+	rfltAvg.r = rfltWeightedAreaSum.r / areaSum;
+	rfltAvg.g = rfltWeightedAreaSum.g / areaSum;
+	rfltAvg.b = rfltWeightedAreaSum.b / areaSum;
+	R.r = 1 / (1 - rfltAvg.r);
+	R.g = 1 / (1 - rfltAvg.g);
+	R.b = 1 / (1 - rfltAvg.b);
+	// average area of unshot radiosity
+	Color avgUnshot(0, 0, 0);
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		avgUnshot.r += patchUnshot[p_id].r * (Store.patchArea[p_id] / areaSum);
+		avgUnshot.g += patchUnshot[p_id].g * (Store.patchArea[p_id] / areaSum);
+		avgUnshot.b += patchUnshot[p_id].b * (Store.patchArea[p_id] / areaSum);
+	}
+
+	return R * avgUnshot;
+}
+
+static const float* codeTable(int format);
+
+// form factor row of the shooting patch, as stored: doubles, or codes
+// turned into F inline so a packed shot reads only 1 or 2 bytes per element
+struct DoubleRow {
+	const double* 	row;
+	double operator[](int e_id) const { return row[e_id]; }
+};
+
+template <class Code>
+struct PackedRow {
+	const Code* 	code;
+	const float* 	table;		// codeTable() of the format
+	double 		scale;		// packedScale of the row
+	double operator[](int e_id) const { return table[code[e_id]] * scale; }
+};
+
+// shoot 'unshot' from patch i to every element through the row Fi
+template <class Row>
+void Solver::shoot(int patch_id, Color unshot, const Row &Fi) {
+	const SceneStore &Store = scene->store;
+	double Ai = Store.patchArea[patch_id];
+
+	for (int element_id = 0; element_id < Store.numElements; element_id++) {
+
+		// 1. determine increase in radiosity of element e due to Bi
+
+		Color dRadiosity;
+
+		uint32_t patchJ = Store.elementPatch[element_id];		// element's patch
+		Color reflectivity = Store.patchReflectance[patchJ];
+		double Fie = Fi[element_id];		// decoded here if packed
+		double Ae = Store.elementArea[element_id];
+		double Aj = Store.patchArea[patchJ];
+
+		dRadiosity.r = reflectivity.r * unshot.r * Fie * (Ai / Ae);
+		dRadiosity.g = reflectivity.g * unshot.g * Fie * (Ai / Ae);
+		dRadiosity.b = reflectivity.b * unshot.b * Fie * (Ai / Ae);
+
+
+		// 2. add area weighted portion of of increased radiosity of element e
+		//	  to radiosity of the patch j which contains element e
+
+		Color *unshotJ = &patchUnshot[patchJ];
+		elementRadiosity[element_id] = elementRadiosity[element_id] + dRadiosity;	/// reflectivity * dAmbient; <- This(Ambient term) is just for display. Should not be added here
+		unshotJ->r = unshotJ->r + dRadiosity.r*(Ae / Aj);
+		unshotJ->g = unshotJ->g + dRadiosity.g*(Ae / Aj);
+		unshotJ->b = unshotJ->b + dRadiosity.b*(Ae / Aj);
+
+	}
+}
+
+// ** Do one step of Progressive Refinement ** //
+void Solver::step() {
+	const SceneStore &Store = scene->store;
+
+	// get the most unshot patch (from priority queue)
+	UnshotTag unshotTag = unshotPatchQueue.top();
+	int mostUnshotID = unshotTag.id;
+	currentPatchID = mostUnshotID;
+
+	Color unshot = patchUnshot[mostUnshotID];
+
+	// 0. overshooting (Feda & Purgathofer, 1992)
+	//    shoot, ahead of time, what patch i is expected to receive later
+	//    (its reflectance times the ambient estimate). it is kept as
+	//    negative unshot radiosity and taken back when i is shot again.
+	Color overshoot(0, 0, 0);
+	if (overshooting) {
+		overshoot = glm::max(Store.patchReflectance[mostUnshotID] * computeAmbient(), Color(0, 0, 0));
+		unshot += overshoot;
+	}
+
+	// 1-2. add the shot to every element, reading the row as stored
+	if (tableFormat == TABLE_DOUBLE) {
+		DoubleRow row = { lookUpTable[mostUnshotID] };
+		shoot(mostUnshotID, unshot, row);
+	}
+	else {
+		size_t offset = (size_t)mostUnshotID * Store.numElements;
+		const float* table = codeTable(tableFormat);
+		double scale = packedScale[mostUnshotID];
+		if (tableFormat == TABLE_LOG8) {
+			PackedRow<uint8_t> row = { (const uint8_t*)packedTable + offset, table, scale };
+			shoot(mostUnshotID, unshot, row);
+		}
+		else {
+			PackedRow<uint16_t> row = { (const uint16_t*)packedTable + offset, table, scale };
+			shoot(mostUnshotID, unshot, row);
+		}
+	}
+
+	// 3. update Ambient
+
+	dAmbient = computeAmbient();
+
+	// 4. reset things
+	patchUnshot[mostUnshotID] = -overshoot;		// current patch's unshot <- 0 (or what was shot ahead)
+	updatePriorityQueue();						// update prioirty queue
+
+	totalStep++;
+
+	// print current step
+	if (printSteps) {
+		cout << "-----------------------------------------------------------------" << endl;
+		cout << "\tPR::Current Step " << totalStep - 1 << endl;
+		cout << "\tPR::Current Unshot Patch: " << mostUnshotID << endl;
+		cout << "\tPR::new Ambient factor: " << dAmbient.r << ", " << dAmbient.g << ", " << dAmbient.b << endl;
+	}
+}
+
+// shared by Solver and StochasticSolver
+
+// area weighted unshot power, |r| + |g| + |b|
+static double unshotPowerOf(const SceneStore &Store, const Color* patchUnshot) {
+	double power = 0;
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		Color u = patchUnshot[p_id];
+		power += (fabs(u.r) + fabs(u.g) + fabs(u.b)) * Store.patchArea[p_id];
+	}
+	return power;
+}
+
+// emitted light only: unshot and element radiosity are the emissivity
+static void resetToEmission(const SceneStore &Store, Color* patchUnshot, Color* elementRadiosity) {
+	for (int p_id = 0; p_id < Store.numPatches; p_id++)
+		patchUnshot[p_id] = Store.patchEmissivity[p_id];
+	for (int e_id = 0; e_id < Store.numElements; e_id++)
+		elementRadiosity[e_id] = Store.patchEmissivity[Store.elementPatch[e_id]];
+}
+
+// call 'advance' until the unshot power drops below 'tolerance' of the
+// emitted power, or 'maxCalls' times. returns the number of calls
+template <class Advance>
+static int runToTolerance(const SceneStore &Store, const Color* patchUnshot, int maxCalls, double tolerance, Advance advance) {
+
+	double emitted = 0;
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		Color e = Store.patchEmissivity[p_id];
+		emitted += (e.r + e.g + e.b) * Store.patchArea[p_id];
+	}
+	double target = emitted * tolerance;
+
+	int calls = 0;
+	while (calls < maxCalls && unshotPowerOf(Store, patchUnshot) > target) {
+		advance();
+		calls++;
+	}
+	return calls;
+}
+
+double Solver::unshotPower() const {
+	return unshotPowerOf(scene->store, patchUnshot);
+}
+
+// put back the emitted light only
+void Solver::reset() {
+	resetToEmission(scene->store, patchUnshot, elementRadiosity);
+	dAmbient = Color(0, 0, 0);
+	totalStep = 0;
+	currentPatchID = 0;
+	updatePriorityQueue();
+}
+
+// shoot until the unshot power drops below 'tolerance' of the emitted
+// power, or 'maxSteps' steps. returns the number of steps taken
+int Solver::run(int maxSteps, double tolerance) {
+	return runToTolerance(scene->store, patchUnshot, maxSteps, tolerance, [this] { step(); });
+}
+
+//		Shooting Comparison		//
+//
+// runs plain and overshooting refinement from the emitted light until
+// the unshot power drops below COMPARE_TOLERANCE of the emitted power,
+// and reports steps, wall clock time and how far the two results are
+// apart. the current solution is restored afterwards.
+
+#define COMPARE_TOLERANCE	0.001
+#define COMPARE_MAX_STEPS	20000
+
+void Solver::compareShootingSchemes() {
+	const SceneStore &Store = scene->store;
+
+	// save current solution
+	vector<Color> savedRadiosity(elementRadiosity, elementRadiosity + Store.numElements);
+	vector<Color> savedUnshot(patchUnshot, patchUnshot + Store.numPatches);
+	int savedStep = totalStep, savedPatch = currentPatchID;
+	bool savedMode = overshooting, savedPrint = printSteps;
+	Color savedAmbient = dAmbient;
+
+	vector<Color> result[2];
+	printSteps = false;
+	cout << "\nCompare::" << Store.numPatches << " patches, " << Store.numElements << " elements, tolerance " << COMPARE_TOLERANCE << endl;
+
+	for (int mode = 0; mode < 2; mode++) {
+		reset();
+		overshooting = (mode != 0);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		run(COMPARE_MAX_STEPS, COMPARE_TOLERANCE);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		result[mode].assign(elementRadiosity, elementRadiosity + Store.numElements);
+		cout << "Compare::" << (mode ? "overshooting" : "plain       ") << " steps: " << totalStep
+			<< "\ttime: " << seconds << " s" << (totalStep >= COMPARE_MAX_STEPS ? "\t(not converged)" : "") << endl;
+	}
+
+	// relative RMS difference of the two solutions
+	double diff = 0, norm = 0;
+	for (int e_id = 0; e_id < Store.numElements; e_id++) {
+		Color d = result[1][e_id] - result[0][e_id];
+		diff += dot(d, d) * Store.elementArea[e_id];
+		norm += dot(result[0][e_id], result[0][e_id]) * Store.elementArea[e_id];
+	}
+	cout << "Compare::relative difference: " << sqrt(diff / norm) << endl;
+
+	// restore
+	memcpy(elementRadiosity, &savedRadiosity[0], Store.numElements * sizeof(Color));
+	memcpy(patchUnshot, &savedUnshot[0], Store.numPatches * sizeof(Color));
+	totalStep = savedStep;
+	currentPatchID = savedPatch;
+	overshooting = savedMode;
+	dAmbient = savedAmbient;
+	printSteps = savedPrint;
+	updatePriorityQueue();
+}
+
+//		Form Factors		//
+
+// form factor table of the whole scene with the hemisphere projector
+void Solver::generateFormFactors() {
+	computeFormFactors<HemisphereProjector>();
+}
+
+// patch to patch form factors of one table row, F(i->j) = sum of F(i->e), e in j
+void Solver::patchFormFactors(int patch_id, vector<double> &Fij) const {
+	const SceneStore &Store = scene->store;
+	vector<double> scratch;
+	const double *row = formFactorRow(patch_id, scratch);
+	Fij.assign(Store.numPatches, 0);
+	for (int e_id = 0; e_id < Store.numElements; e_id++)
+		Fij[Store.elementPatch[e_id]] += row[e_id];
+}
+
+// row sum and reciprocity report of the table in lookUpTable
+void Solver::reportFormFactorConsistency() const {
+	const SceneStore &Store = scene->store;
+
+	// a report only, skip the work when nobody reads it
+	if (!printSteps)
+		return;
+
+	vector< vector<double> > Fij(Store.numPatches);
+	for (int i = 0; i < Store.numPatches; i++)
+		patchFormFactors(i, Fij[i]);
+
+	// 1. row sums: at most 1, and 1 in a closed scene
+	double minSum = 1e30, maxSum = 0, avgSum = 0;
+	int overOne = 0;
+	for (int i = 0; i < Store.numPatches; i++) {
+		double sum = 0;
+		for (int j = 0; j < Store.numPatches; j++)
+			sum += Fij[i][j];
+		minSum = std::min(minSum, sum);
+		maxSum = std::max(maxSum, sum);
+		avgSum += sum / Store.numPatches;
+		if (sum > 1 + 1e-3) overOne++;
+	}
+
+	// 2. reciprocity: Ai F(i->j) = Aj F(j->i)
+	double maxError = 0, avgError = 0;
+	int pairs = 0;
+	for (int i = 0; i < Store.numPatches; i++) {
+		for (int j = i + 1; j < Store.numPatches; j++) {
+			double a = Store.patchArea[i] * Fij[i][j];
+			double b = Store.patchArea[j] * Fij[j][i];
+			if (std::max(a, b) <= 0) continue;
+			double error = fabs(a - b) / std::max(a, b);
+			maxError = std::max(maxError, error);
+			avgError += error;
+			pairs++;
+		}
+	}
+	if (pairs) avgError /= pairs;
+
+	cout << "FormFactors::row sum min " << minSum << ", max " << maxSum << ", avg " << avgSum
+		<< " (" << overOne << " rows over 1)" << endl;
+	cout << "FormFactors::reciprocity error avg " << avgError << ", max " << maxError
+		<< " over " << pairs << " patch pairs" << endl;
+}
+
+// write the table as csv, columns in file order
+bool Solver::writeLookUpTable(const std::string &fileName) const {
+	const SceneStore &Store = scene->store;
+
+	ofstream file(fileName.c_str());
+	if (!file) {
+		cout << "WriteLUTable::cannot open " << fileName << endl;
+		return false;
+	}
+	file << "F/E";
+	for (int id = 0; id < Store.numElements; id++)	// write first row (element id)
+		file << "," << id;
+	file << endl;
+
+	// columns are kept in file order, independent of storage order
+	vector<double> scratch;
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		const double *row = formFactorRow(p_id, scratch);
+		file << p_id;
+		for (int e_id = 0; e_id < Store.numElements; e_id++) {
+			file << "," << row[Store.elementIndex[e_id]];
+		}
+		// move to next line
+		file << endl;
+	}
+	file.close();
+	return true;
+}
+
+// load a table written by writeLookUpTable
+bool Solver::loadLookUpTable(const std::string &fileName) {
+	const SceneStore &Store = scene->store;
+
+	if (printSteps)
+		cout << "LoadLUTable::start reading file..." << endl;
+
+	ifstream file;
+	double totalSum = 0;
+	file.open(fileName.c_str());
+	if (!file) {
+		cout << "LoadLUTable::cannot open " << fileName << endl;
+		return false;
+	}
+
+	// read first line - element id, one column per element
+	string line;
+	getline(file, line);
+	int columns = (int)count(line.begin(), line.end(), ',');
+	if (columns != Store.numElements) {
+		cout << "LoadLUTable::" << fileName << " has " << columns << " element columns, scene has " << Store.numElements << endl;
+		return false;
+	}
+
+	unpackTable();
+
+	// read table, one row per patch: patch id, then the form factors
+	int rows = 0;
+	bool valid = true;
+	while (valid && getline(file, line)) {
+		if (line.empty() || line == "\r")
+			continue;
+		if (rows == Store.numPatches) {
+			valid = false;
+			break;
+		}
+
+		const char* p = line.c_str();
+		char* next;
+		long id = strtol(p, &next, 10);
+		valid = (next != p && id == rows);
+		p = next;
+		for (int e_id = 0; valid && e_id < Store.numElements; e_id++) {
+			valid = (*p++ == ',');
+			double val = strtod(p, &next);
+			valid = valid && next != p;
+			p = next;
+			lookUpTable[rows][Store.elementIndex[e_id]] = val;	// columns are in file order
+			totalSum += val;
+		}
+		while (*p == ' ' || *p == '\r')
+			p++;
+		valid = valid && *p == 0;
+		if (valid)
+			rows++;
+	}
+	file.close();
+
+	// a partly read table is worse than none
+	if (!valid || rows != Store.numPatches) {
+		cout << "LoadLUTable::" << fileName << " does not match the scene (" << Store.numPatches << " patches x "
+			<< Store.numElements << " elements), " << rows << " good rows" << endl;
+		for (int p_id = 0; p_id < Store.numPatches; p_id++)
+			fill(lookUpTable[p_id], lookUpTable[p_id] + Store.numElements, 0.0);
+		formFactorHash = 0;			// no table, as after construction
+		return false;
+	}
+
+	formFactorHash = computeFormFactorHash();
+	reportFormFactorConsistency();
+
+	if (printSteps) {
+		cout << "LoadLUTable::total form factor: " << totalSum << endl;
+		cout << "LoadLUTable::file reading done.\n" << endl;
+	}
+	return true;
+}
+
+//		Packed Table		//
+//
+// rows of the form factor table as 8 or 16-bit codes of F / scale
+// (see TABLE_* in radiosity.h). a row is turned back into doubles
+// through a code table when it is shot.
+
+#define LOG16_OCTAVES	32
+#define LOG8_OCTAVES	16
+
+// bytes per table entry
+static int tableBytes(int format) {
+	switch (format) {
+	case TABLE_HALF:
+	case TABLE_LOG16:	return 2;
+	case TABLE_LOG8:	return 1;
+	default:		return sizeof(double);
+	}
+}
+
+// fp16 bits of 0 <= x <= 1, rounded to nearest
+static uint16_t floatToHalf(float x) {
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	if (x <= 0) return 0;
+
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (exponent <= 0) {			// subnormal half
+		if (exponent < -10) return 0;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1) half++;
+		return (uint16_t)half;
+	}
+	uint32_t half = (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000) half++;		// may carry into the exponent, which is still right
+	return (uint16_t)half;
+}
+
+static float halfToFloat(uint16_t half) {
+	int exponent = (half >> 10) & 0x1F;
+	int mantissa = half & 0x3FF;
+	if (exponent == 0) return ldexpf((float)mantissa, -24);
+	return ldexpf((float)(mantissa | 0x400), exponent - 25);
+}
+
+// code of 0 <= x <= 1 on a log2 scale. 0 is zero, codes 1 .. levels
+// span 2^-octaves .. 1
+static uint16_t logCode(double x, int levels, int octaves) {
+	if (x <= 0) return 0;
+	double c = levels + log2(x) * (levels - 1) / octaves;
+	if (c < 0.5) return 0;
+	return (uint16_t)std::min((double)levels, floor(c + 0.5));
+}
+
+static float logValue(int code, int levels, int octaves) {
+	if (code == 0) return 0;
+	return (float)exp2((double)(code - levels) * octaves / (levels - 1));
+}
+
+static uint16_t encodeFormFactor(int format, double x) {
+	switch (format) {
+	case TABLE_HALF:	return floatToHalf((float)x);
+	case TABLE_LOG16:	return logCode(x, 65535, LOG16_OCTAVES);
+	default:		return logCode(x, 255, LOG8_OCTAVES);
+	}
+}
+
+static vector<float> buildCodeTable(int format) {
+	vector<float> table(format == TABLE_LOG8 ? 256 : 65536);
+	for (int code = 0; code < (int)table.size(); code++) {
+		if (format == TABLE_HALF) table[code] = halfToFloat((uint16_t)code);
+		else if (format == TABLE_LOG16) table[code] = logValue(code, 65535, LOG16_OCTAVES);
+		else table[code] = logValue(code, 255, LOG8_OCTAVES);
+	}
+	return table;
+}
+
+// value of every code of 'format', in units of the row scale
+static const float* codeTable(int format) {
+	static const vector<float> half = buildCodeTable(TABLE_HALF);
+	static const vector<float> log16 = buildCodeTable(TABLE_LOG16);
+	static const vector<float> log8 = buildCodeTable(TABLE_LOG8);
+	switch (format) {
+	case TABLE_HALF:	return &half[0];
+	case TABLE_LOG16:	return &log16[0];
+	default:		return &log8[0];
+	}
+}
+
+// one row of the table in doubles. returns the row itself, or decodes
+// a packed row into 'scratch'
+const double* Solver::formFactorRow(int patch_id, vector<double> &scratch) const {
+
+	if (tableFormat == TABLE_DOUBLE)
+		return lookUpTable[patch_id];
+
+	int n = scene->store.numElements;
+	const float* table = codeTable(tableFormat);
+	double scale = packedScale[patch_id];
+	scratch.resize(n);
+
+	if (tableFormat == TABLE_LOG8) {
+		const uint8_t* code = (const uint8_t*)packedTable + (size_t)patch_id * n;
+		for (int e_id = 0; e_id < n; e_id++)
+			scratch[e_id] = table[code[e_id]] * scale;
+	}
+	else {
+		const uint16_t* code = (const uint16_t*)packedTable + (size_t)patch_id * n;
+		for (int e_id = 0; e_id < n; e_id++)
+			scratch[e_id] = table[code[e_id]] * scale;
+	}
+	return &scratch[0];
+}
+
+// back to one double row per patch
+void Solver::unpackTable() {
+
+	if (tableFormat == TABLE_DOUBLE)
+		return;
+
+	int n = scene->store.numElements;
+	vector<double> scratch;
+	for (int p_id = 0; p_id < scene->store.numPatches; p_id++) {
+		const double *row = formFactorRow(p_id, scratch);
+		lookUpTable[p_id] = new double[n];
+		memcpy(lookUpTable[p_id], row, n * sizeof(double));
+	}
+
+	delete[] packedTable;
+	delete[] packedScale;
+	packedTable = 0;
+	packedScale = 0;
+	tableFormat = TABLE_DOUBLE;
+}
+
+// store the table in 'format', and report what that costs in accuracy
+void Solver::packTable(int format) {
+	const SceneStore &Store = scene->store;
+	static const char* formatName[] = { "double", "fp16", "log 16-bit", "log 8-bit" };
+
+	if (format == tableFormat)
+		return;
+	unpackTable();
+	if (format == TABLE_DOUBLE)
+		return;
+
+	int n = Store.numElements;
+	int bytes = tableBytes(format);
+	const float* table = codeTable(format);
+	packedTable = new unsigned char[(size_t)Store.numPatches * n * bytes];
+	packedScale = new double[Store.numPatches];
+
+	double maxRelError = 0, maxAbsError = 0, maxSumError = 0;
+	double dropped = 0, total = 0;
+	vector<uint16_t> code(n);
+
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		double *row = lookUpTable[p_id];
+
+		double rowMax = 0, rowSum = 0;
+		for (int e_id = 0; e_id < n; e_id++) {
+			rowMax = std::max(rowMax, row[e_id]);
+			rowSum += row[e_id];
+		}
+
+		// 1. quantize F / rowMax
+		double codeSum = 0;
+		for (int e_id = 0; e_id < n; e_id++) {
+			code[e_id] = (rowMax > 0) ? encodeFormFactor(format, row[e_id] / rowMax) : 0;
+			codeSum += table[code[e_id]];
+		}
+
+		// 2. pick the scale that keeps the row sum, so no energy
+		//    is made or lost by packing
+		double scale = (codeSum > 0) ? rowSum / codeSum : 0;
+		packedScale[p_id] = scale;
+		if (format == TABLE_LOG8) {
+			uint8_t* out = (uint8_t*)packedTable + (size_t)p_id * n;
+			for (int e_id = 0; e_id < n; e_id++) out[e_id] = (uint8_t)code[e_id];
+		}
+		else
+			memcpy((uint16_t*)packedTable + (size_t)p_id * n, &code[0], n * sizeof(uint16_t));
+
+		// 3. error of this row
+		double packedSum = 0;
+		for (int e_id = 0; e_id < n; e_id++) {
+			double F = table[code[e_id]] * scale;
+			double error = fabs(F - row[e_id]);
+			packedSum += F;
+			if (rowMax > 0) maxAbsError = std::max(maxAbsError, error / rowMax);
+			if (row[e_id] > 1e-3 * rowMax)
+				maxRelError = std::max(maxRelError, error / row[e_id]);
+			if (code[e_id] == 0)
+				dropped += row[e_id];
+		}
+		total += rowSum;
+		if (rowSum > 0)
+			maxSumError = std::max(maxSumError, fabs(packedSum - rowSum) / rowSum);
+
+		delete[] row;
+		lookUpTable[p_id] = 0;
+	}
+	tableFormat = format;
+	formFactorHash = computeFormFactorHash();
+
+	double before = (double)Store.numPatches * n * sizeof(double) / (1024 * 1024);
+	double after = ((double)Store.numPatches * n * bytes + Store.numPatches * sizeof(double)) / (1024 * 1024);
+	if (!printSteps)
+		return;
+	cout << "FormFactors::packed table to " << formatName[format] << ", " << before << " MB -> " << after << " MB" << endl;
+	cout << "FormFactors::max error " << maxRelError << " relative (F > 1e-3 of row max), "
+		<< maxAbsError << " of row max, " << (total > 0 ? dropped / total : 0) << " of the total dropped" << endl;
+	cout << "FormFactors::energy check: max row sum change " << maxSumError << endl;
+}
+
+//		Form Factor Cache		//
+//
+// binary copy of the table, packed or not:
+//	FormFactorCacheHeader
+//	double scale[numPatches]			(packed only)
+//	code or double [numPatches][numElements]	(storage order)
+// storage order is part of the scene hash, so a cache only loads into
+// the scene it was written from.
+
+#define FFCACHE_MAGIC		0x43464652	// "RFFC"
+#define FFCACHE_VERSION		1
+
+struct FormFactorCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t numPatches;
+	uint32_t numElements;
+	uint32_t pad;
+	uint64_t sceneHash;
+	uint64_t formFactorHash;
+};
+
+bool Solver::saveFormFactorCache(const std::string &fileName) const {
+	const SceneStore &Store = scene->store;
+
+	ofstream file(fileName.c_str(), ios::binary | ios::trunc);
+	if (!file) {
+		cout << "FFCache::cannot open " << fileName << endl;
+		return false;
+	}
+
+	FormFactorCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic 		= FFCACHE_MAGIC;
+	header.version 		= FFCACHE_VERSION;
+	header.format 		= tableFormat;
+	header.numPatches 	= Store.numPatches;
+	header.numElements 	= Store.numElements;
+	header.sceneHash 	= scene->hash;
+	header.formFactorHash 	= formFactorHash;
+	file.write((const char*)&header, sizeof(header));
+
+	if (tableFormat == TABLE_DOUBLE) {
+		for (int p_id = 0; p_id < Store.numPatches; p_id++)
+			file.write((const char*)lookUpTable[p_id], Store.numElements * sizeof(double));
+	}
+	else {
+		file.write((const char*)packedScale, Store.numPatches * sizeof(double));
+		file.write((const char*)packedTable, (size_t)Store.numPatches * Store.numElements * tableBytes(tableFormat));
+	}
+	file.close();
+
+	if (!file) {
+		cout << "FFCache::failed to write " << fileName << endl;
+		return false;
+	}
+	if (printSteps)
+		cout << "FFCache::saved table to " << fileName << endl;
+	return true;
+}
+
+bool Solver::loadFormFactorCache(const std::string &fileName) {
+	const SceneStore &Store = scene->store;
+
+	ifstream file(fileName.c_str(), ios::binary);
+	if (!file)
+		return false;
+
+	FormFactorCacheHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || header.magic != FFCACHE_MAGIC || header.version != FFCACHE_VERSION || header.format > TABLE_LOG8) {
+		cout << "FFCache::not a form factor cache" << endl;
+		return false;
+	}
+	if (header.numPatches != (uint32_t)Store.numPatches || header.numElements != (uint32_t)Store.numElements
+		|| header.sceneHash != scene->hash) {
+		cout << "FFCache::scene does not match" << endl;
+		return false;
+	}
+
+	// read everything before touching the current table
+	int format = header.format;
+	size_t valueBytes = (size_t)Store.numPatches * Store.numElements * tableBytes(format);
+	vector<double> scale(format == TABLE_DOUBLE ? 0 : Store.numPatches);
+	unsigned char* values = new unsigned char[valueBytes];
+	if (!scale.empty())
+		file.read((char*)&scale[0], scale.size() * sizeof(double));
+	file.read((char*)values, valueBytes);
+	if (!file) {
+		cout << "FFCache::file is truncated" << endl;
+		delete[] values;
+		return false;
+	}
+
+	// install
+	unpackTable();
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		if (format == TABLE_DOUBLE)
+			memcpy(lookUpTable[p_id], values + (size_t)p_id * Store.numElements * sizeof(double), Store.numElements * sizeof(double));
+		else {
+			delete[] lookUpTable[p_id];
+			lookUpTable[p_id] = 0;
+		}
+	}
+	if (format == TABLE_DOUBLE)
+		delete[] values;
+	else {
+		packedTable = values;
+		packedScale = new double[Store.numPatches];
+		memcpy(packedScale, &scale[0], Store.numPatches * sizeof(double));
+	}
+	tableFormat = format;
+	formFactorHash = header.formFactorHash;
+
+	reportFormFactorConsistency();
+	if (printSteps)
+		cout << "FFCache::loaded table from " << fileName << endl;
+	return true;
+}
+
+// average element colours at the vertices, plus reflectance * 'ambient'
+// if it is given
+static void averageAtVertices(const SceneStore &Store, const Color* elementColor, const Color* ambient, Color* vertexColor) {
+
+	// bilinear interpolation
+	// with neighboring patches
+
+	struct ColorStack {
+		int count;
+		Color color;
+		ColorStack() : count(0), color(Color(0, 0, 0)) {}
+	};
+
+	ColorStack *colorStack = new ColorStack[Store.numVertices];
+
+	// update vertex radiosity
+	// by each element
+	for (int i = 0; i < Store.numElements; i++) {
+
+		// add radiosity color
+
+		Color color = elementColor[i];
+		if (ambient)
+			color += Store.patchReflectance[Store.elementPatch[i]] * *ambient;
+
+		const uint32_t *ev = &Store.elementVertices[4 * i];
+		colorStack[ev[0]].color += color;
+		colorStack[ev[1]].color += color;
+		colorStack[ev[2]].color += color;
+		colorStack[ev[3]].color += color;
+
+		// increment count
+		colorStack[ev[0]].count += 1;
+		colorStack[ev[1]].count += 1;
+		colorStack[ev[2]].count += 1;
+		colorStack[ev[3]].count += 1;
+	}
+
+	// average color
+	for (int i = 0; i < Store.numVertices; i++) {
+		if (colorStack[i].count == 0) {		// patch corner, not used by any element
+			vertexColor[i] = Color(0, 0, 0);
+			continue;
+		}
+		vertexColor[i].r = colorStack[i].color.r / colorStack[i].count;
+		vertexColor[i].g = colorStack[i].color.g / colorStack[i].count;
+		vertexColor[i].b = colorStack[i].color.b / colorStack[i].count;
+	}
+
+	delete[] colorStack;
+}
+
+// update vertex color, optionally with the ambient term
+void Solver::updateVertexColor(bool addAmbient) {
+	averageAtVertices(scene->store, elementRadiosity, addAmbient ? &dAmbient : 0, vertexColor);
+}
+
+//		Checkpoint		//
+//
+// binary snapshot of the solver state:
+//	CheckpointHeader
+//	Color unshot[numPatches]
+//	Color radiosity[numElements]	(file order)
+// the snapshot is taken on the calling thread, written to disk on a
+// background thread, then renamed over the previous checkpoint.
+
+#define CHECKPOINT_MAGIC	0x504B4352	// "RCKP"
+#define CHECKPOINT_VERSION	1
+
+struct CheckpointHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numPatches;
+	uint32_t numElements;
+	uint64_t sceneHash;
+	uint64_t formFactorHash;
+	int32_t  totalStep;
+	int32_t  currentPatchID;
+	float 	 dAmbient[3];
+	uint32_t pad;
+};
+
+// replace fileName with the freshly written tempName
+static bool replaceFile(const string &tempName, const string &fileName) {
+#ifdef _WIN32
+	return MoveFileExA(tempName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(tempName.c_str(), fileName.c_str()) == 0;
+#endif
+}
+
+// checkpoint writer thread, one snapshot at a time
+void Solver::checkpointLoop() {
+
+	std::unique_lock<std::mutex> lock(checkpointMutex);
+	while (true) {
+		checkpointWake.wait(lock, [this] { return checkpointQuit || checkpointPending; });
+		if (!checkpointPending)
+			break;		// quit, and nothing left to write
+
+		vector<char>* buffer = checkpointPending;
+		string fileName = checkpointName;
+		checkpointPending = 0;
+
+		lock.unlock();
+		string tempName = fileName + ".tmp";
+		ofstream file(tempName.c_str(), ios::binary | ios::trunc);
+		file.write(&(*buffer)[0], buffer->size());
+		file.close();
+
+		if (!file)
+			cout << "Checkpoint::failed to write " << tempName << endl;
+		else if (!replaceFile(tempName, fileName))
+			cout << "Checkpoint::failed to rename " << tempName << " to " << fileName << endl;
+		delete buffer;
+		lock.lock();
+
+		checkpointBusy = false;
+		checkpointWake.notify_all();
+	}
+}
+
+// block until the last checkpoint has landed
+void Solver::waitCheckpoint() {
+	std::unique_lock<std::mutex> lock(checkpointMutex);
+	checkpointWake.wait(lock, [this] { return !checkpointBusy; });
+}
+
+// snapshot solver state and write it in the background.
+// skipped (returns false) while the previous write is still running
+bool Solver::saveCheckpoint(const std::string &fileName) {
+	const SceneStore &Store = scene->store;
+
+	{
+		std::lock_guard<std::mutex> lock(checkpointMutex);
+		if (checkpointBusy) {
+			cout << "Checkpoint::previous write still running, skipped step " << totalStep << endl;
+			return false;
+		}
+		checkpointBusy = true;
+	}
+
+	size_t patchBytes = Store.numPatches * sizeof(Color);
+	size_t elementBytes = Store.numElements * sizeof(Color);
+	vector<char>* buffer = new vector<char>(sizeof(CheckpointHeader) + patchBytes + elementBytes);
+
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic 		= CHECKPOINT_MAGIC;
+	header.version 		= CHECKPOINT_VERSION;
+	header.numPatches 	= Store.numPatches;
+	header.numElements 	= Store.numElements;
+	header.sceneHash 	= scene->hash;
+	header.formFactorHash 	= formFactorHash;
+	header.totalStep 	= totalStep;
+	header.currentPatchID 	= currentPatchID;
+	header.dAmbient[0] 	= dAmbient.r;
+	header.dAmbient[1] 	= dAmbient.g;
+	header.dAmbient[2] 	= dAmbient.b;
+
+	char* cursor = &(*buffer)[0];
+	memcpy(cursor, &header, sizeof(header));
+	cursor += sizeof(header);
+	memcpy(cursor, patchUnshot, patchBytes);
+	cursor += patchBytes;
+	Color* radiosity = (Color*)cursor;
+	for (int e_id = 0; e_id < Store.numElements; e_id++)
+		radiosity[e_id] = elementRadiosity[Store.elementIndex[e_id]];
+
+	{
+		std::lock_guard<std::mutex> lock(checkpointMutex);
+		checkpointPending = buffer;
+		checkpointName = fileName;
+		checkpointWake.notify_all();
+	}
+
+	if (printSteps)
+		cout << "Checkpoint::saved step " << totalStep << " to " << fileName << endl;
+	return true;
+}
+
+// restore solver state. returns false if the file does not match
+// the scene and form factor table of this solver
+bool Solver::loadCheckpoint(const std::string &fileName) {
+	const SceneStore &Store = scene->store;
+
+	// make sure a pending write has landed
+	waitCheckpoint();
+
+	ifstream file(fileName.c_str(), ios::binary);
+	if (!file) {
+		cout << "Checkpoint::cannot open " << fileName << endl;
+		return false;
+	}
+
+	CheckpointHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION) {
+		cout << "Checkpoint::not a checkpoint file" << endl;
+		return false;
+	}
+	if (header.numPatches != (uint32_t)Store.numPatches || header.numElements != (uint32_t)Store.numElements
+		|| header.sceneHash != scene->hash) {
+		cout << "Checkpoint::scene does not match" << endl;
+		return false;
+	}
+	if (header.formFactorHash != formFactorHash) {
+		cout << "Checkpoint::form factor table does not match" << endl;
+		return false;
+	}
+
+	vector<Color> unshot(Store.numPatches), radiosity(Store.numElements);
+	file.read((char*)&unshot[0], Store.numPatches * sizeof(Color));
+	file.read((char*)&radiosity[0], Store.numElements * sizeof(Color));
+	if (!file) {
+		cout << "Checkpoint::file is truncated" << endl;
+		return false;
+	}
+
+	memcpy(patchUnshot, &unshot[0], Store.numPatches * sizeof(Color));
+	for (int e_id = 0; e_id < Store.numElements; e_id++)
+		elementRadiosity[Store.elementIndex[e_id]] = radiosity[e_id];
+	totalStep 	= header.totalStep;
+	currentPatchID 	= header.currentPatchID;
+	dAmbient 	= Color(header.dAmbient[0], header.dAmbient[1], header.dAmbient[2]);
+
+	updatePriorityQueue();
+
+	if (printSteps)
+		cout << "Checkpoint::restored step " << totalStep << " from " << fileName << endl;
+	return true;
+}
+
+//		Frame Log		//
+//
+// optional stream of solver progress (see frameLog.h). logFrame()
+// diffs element radiosities against the last logged frame and queues
+// the encoded frame; a writer thread appends queued frames to the file.
+
+// writer thread body
+void Solver::frameLogLoop() {
+
+	std::unique_lock<std::mutex> lock(frameLogMutex);
+	while (true) {
+		frameLogWake.wait(lock, [this] { return frameLogQuit || !frameLogQueue.empty(); });
+		if (frameLogQueue.empty())
+			break;		// quit, and everything is written
+
+		vector<char>* frame = frameLogQueue.front();
+		frameLogQueue.pop();
+
+		lock.unlock();
+		fwrite(&(*frame)[0], 1, frame->size(), frameLog);
+		fflush(frameLog);
+		delete frame;
+		lock.lock();
+	}
+}
+
+// flush queued frames and close the log
+void Solver::closeFrameLog() {
+	{
+		std::lock_guard<std::mutex> lock(frameLogMutex);
+		frameLogQuit = true;
+		frameLogWake.notify_one();
+	}
+	if (frameLogThread.joinable())
+		frameLogThread.join();
+	if (frameLog)
+		fclose(frameLog);
+	frameLog = 0;
+	frameLogQuit = false;
+}
+
+// create the log file and start the writer
+bool Solver::openFrameLog(const std::string &fileName) {
+	const SceneStore &Store = scene->store;
+
+	closeFrameLog();
+	frameLog = fopen(fileName.c_str(), "wb");
+	if (!frameLog) {
+		cout << "FrameLog::cannot open " << fileName << endl;
+		return false;
+	}
+
+	FrameLogHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic 		= FRAMELOG_MAGIC;
+	header.version 		= FRAMELOG_VERSION;
+	header.numPatches 	= Store.numPatches;
+	header.numElements 	= Store.numElements;
+	header.sceneHash 	= scene->hash;
+	fwrite(&header, sizeof(header), 1, frameLog);
+
+	frameLogLast.assign(Store.numElements, Color(0, 0, 0));
+	frameLogThread = std::thread(&Solver::frameLogLoop, this);
+
+	if (printSteps)
+		cout << "FrameLog::writing to " << fileName << endl;
+	return true;
+}
+
+// encode changes since the last frame and queue them.
+// does nothing unless openFrameLog() succeeded
+void Solver::logFrame() {
+	const SceneStore &Store = scene->store;
+
+	if (!frameLog)
+		return;
+
+	vector<char>* frame = new vector<char>(sizeof(FrameHeader));
+	vector<char> &out = *frame;
+	out.reserve(sizeof(FrameHeader) + Store.numElements);
+
+	// 1. changed elements, file order
+	uint32_t numChanged = 0;
+	int nextId = 0;
+	for (int e_id = 0; e_id < Store.numElements; e_id++) {
+		Color radiosity = elementRadiosity[Store.elementIndex[e_id]];
+		Color delta = radiosity - frameLogLast[e_id];
+		if (delta.r == 0 && delta.g == 0 && delta.b == 0)
+			continue;
+
+		writeVarint(out, e_id - nextId);
+		out.insert(out.end(), (const char*)&delta, (const char*)&delta + 3 * sizeof(float));
+		nextId = e_id + 1;
+		numChanged++;
+
+		// keep what the reader will rebuild, so rounding does not drift
+		frameLogLast[e_id] += delta;
+	}
+
+	// 2. convergence stats
+	double areaSum = 0;
+	Color avgUnshot(0, 0, 0);
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		areaSum += Store.patchArea[p_id];
+		avgUnshot += patchUnshot[p_id] * (float)Store.patchArea[p_id];
+	}
+	avgUnshot /= (float)areaSum;
+
+	FrameHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic 		= FRAMELOG_FRAME_MAGIC;
+	header.step 		= totalStep;
+	header.shotPatch 	= currentPatchID;
+	header.numChanged 	= numChanged;
+	header.dAmbient[0] 	= dAmbient.r;
+	header.dAmbient[1] 	= dAmbient.g;
+	header.dAmbient[2] 	= dAmbient.b;
+	header.avgUnshot[0] 	= avgUnshot.r;
+	header.avgUnshot[1] 	= avgUnshot.g;
+	header.avgUnshot[2] 	= avgUnshot.b;
+	header.payloadBytes 	= (uint32_t)(out.size() - sizeof(FrameHeader));
+	memcpy(&out[0], &header, sizeof(header));
+
+	std::lock_guard<std::mutex> lock(frameLogMutex);
+	frameLogQueue.push(frame);
+	frameLogWake.notify_one();
+}
+
+
+//		Stochastic Solver		//
+
+#define BVH_LEAF_SIZE		4	// elements per BVH leaf
+
+// splitmix64 (Steele et al.), random stream of one ray batch
+static uint64_t splitMix(uint64_t &state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static double uniform(uint64_t &state) {
+	return (splitMix(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// u, v completing 'n' to an orthonormal frame (Duff et al., 2017)
+static void orthonormalBasis(vec3 n, vec3 &u, vec3 &v) {
+	float sign = n.z >= 0 ? 1.0f : -1.0f;
+	float a = -1.0f / (sign + n.z);
+	float b = n.x * n.y * a;
+	u = vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	v = vec3(b, sign + n.y * n.y * a, -n.y);
+}
+
+// distance along the ray to triangle (a, b, c), Moller & Trumbore
+static bool hitTriangle(vec3 o, vec3 d, vec3 a, vec3 b, vec3 c, float tMin, float &t) {
+	vec3 e1 = b - a, e2 = c - a;
+	vec3 p = cross(d, e2);
+	float det = dot(e1, p);
+	if (fabs(det) < 1e-12f) return false;
+	float inv = 1.0f / det;
+	vec3 s = o - a;
+	float u = dot(s, p) * inv;
+	if (u < 0 || u > 1) return false;
+	vec3 q = cross(s, e1);
+	float v = dot(d, q) * inv;
+	if (v < 0 || u + v > 1) return false;
+	float h = dot(e2, q) * inv;
+	if (h <= tMin || h >= t) return false;
+	t = h;
+	return true;
+}
+
+// entry distance of the ray into a box, 'invDir' = 1 / dir
+static bool hitBox(vec3 o, vec3 invDir, vec3 lo, vec3 hi, float tMax, float &tEnter) {
+	float ax = (lo.x - o.x) * invDir.x, bx = (hi.x - o.x) * invDir.x;
+	float ay = (lo.y - o.y) * invDir.y, by = (hi.y - o.y) * invDir.y;
+	float az = (lo.z - o.z) * invDir.z, bz = (hi.z - o.z) * invDir.z;
+	float t0 = std::max(std::max(std::min(ax, bx), std::min(ay, by)), std::max(std::min(az, bz), 0.0f));
+	float t1 = std::min(std::min(std::max(ax, bx), std::max(ay, by)), std::min(std::max(az, bz), tMax));
+	tEnter = t0;
+	return t0 <= t1;
+}
+
+StochasticSolver::StochasticSolver(const Scene &scene_, int numThreads_) : scene(&scene_),
+	seed(1), numThreads(numThreads_), iteration(0), totalRays(0), printSteps(false) {
+
+	const SceneStore &Store = scene->store;
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	// 0. solution columns
+
+	arena = new char[64 + 2 * columnBytes(Store.numElements, sizeof(Color))
+		+ columnBytes(Store.numPatches, sizeof(Color)) + columnBytes(Store.numVertices, sizeof(Color))];
+	char* cursor = alignArena(arena);
+	elementRadiosity 	= carveColumn<Color>(cursor, Store.numElements);
+	elementVariance 	= carveColumn<Color>(cursor, Store.numElements);
+	patchUnshot 		= carveColumn<Color>(cursor, Store.numPatches);
+	vertexColor 		= carveColumn<Color>(cursor, Store.numVertices);
+
+	// 1. BVH over the elements
+
+	vector<vec3> centers(Store.elementCenter, Store.elementCenter + Store.numElements);
+	bvhElements.resize(Store.numElements);
+	for (int e_id = 0; e_id < Store.numElements; e_id++)
+		bvhElements[e_id] = e_id;
+	bvh.reserve(2 * Store.numElements / BVH_LEAF_SIZE + 1);
+	if (Store.numElements > 0)
+		buildNode(centers, 0, Store.numElements);
+	rayEpsilon = bvh.empty() ? 0 : 1e-5f * length(bvh[0].hi - bvh[0].lo);
+
+	// 2. area up to each element of its patch, to pick ray origins
+
+	elementCdf.resize(Store.numElements);
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		float sum = 0;
+		for (uint32_t k = Store.patchElementStart[p_id]; k < Store.patchElementStart[p_id + 1]; k++) {
+			sum += Store.elementArea[Store.patchElements[k]];
+			elementCdf[k] = sum;
+		}
+	}
+
+	// 3. per thread tallies
+
+	tallies.resize(numThreads);
+	for (int t = 0; t < numThreads; t++) {
+		tallies[t].radiosity.resize(Store.numElements);
+		tallies[t].square.resize(Store.numElements);
+		tallies[t].received.resize(Store.numPatches);
+	}
+
+	reset();
+}
+
+StochasticSolver::~StochasticSolver() {
+	delete[] arena;
+}
+
+// node over bvhElements[first, first + count), split at the median of
+// the longest axis of the element centers. returns the node index
+int StochasticSolver::buildNode(vector<vec3> &centers, int first, int count) {
+	const SceneStore &Store = scene->store;
+
+	int index = (int)bvh.size();
+	bvh.push_back(BVHNode());
+
+	vec3 lo(1e30f), hi(-1e30f), clo(1e30f), chi(-1e30f);
+	for (int i = first; i < first + count; i++) {
+		int e_id = bvhElements[i];
+		for (int m = 0; m < 4; m++) {
+			vec3 p = Store.vertexPosition[Store.elementVertices[4 * e_id + m]];
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		clo = glm::min(clo, centers[e_id]);
+		chi = glm::max(chi, centers[e_id]);
+	}
+	bvh[index].lo = lo;
+	bvh[index].hi = hi;
+
+	if (count <= BVH_LEAF_SIZE) {
+		bvh[index].first = first;
+		bvh[index].count = count;
+		return index;
+	}
+
+	vec3 extent = chi - clo;
+	int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	int half = count / 2;
+	std::nth_element(bvhElements.begin() + first, bvhElements.begin() + first + half, bvhElements.begin() + first + count,
+		[&](int32_t a, int32_t b) { return centers[a][axis] < centers[b][axis]; });
+
+	buildNode(centers, first, half);
+	int right = buildNode(centers, first + half, count - half);
+	bvh[index].first = right;
+	bvh[index].count = 0;
+	return index;
+}
+
+// nearest element along the ray, elements of 'ignorePatch' are skipped
+bool StochasticSolver::trace(vec3 origin, vec3 dir, int ignorePatch, int &element_id) const {
+	const SceneStore &Store = scene->store;
+
+	vec3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+	float t = 1e30f;
+	element_id = -1;
+
+	// nodes still to visit, with the distance the ray enters them
+	int stack[64];
+	float enter[64];
+	int top = 0;
+	float tRoot;
+	if (!bvh.empty() && hitBox(origin, invDir, bvh[0].lo, bvh[0].hi, t, tRoot)) {
+		stack[top] = 0;
+		enter[top++] = tRoot;
+	}
+	while (top > 0) {
+		top--;
+		if (enter[top] >= t)		// a nearer hit was found meanwhile
+			continue;
+		const BVHNode &node = bvh[stack[top]];
+
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				int e_id = bvhElements[i];
+				if ((int)Store.elementPatch[e_id] == ignorePatch)
+					continue;
+				const uint32_t *ev = &Store.elementVertices[4 * e_id];
+				vec3 a = Store.vertexPosition[ev[0]], b = Store.vertexPosition[ev[1]];
+				vec3 c = Store.vertexPosition[ev[2]], d = Store.vertexPosition[ev[3]];
+				if (hitTriangle(origin, dir, a, b, c, rayEpsilon, t) || hitTriangle(origin, dir, a, c, d, rayEpsilon, t))
+					element_id = e_id;
+			}
+			continue;
+		}
+
+		// nearer child last, so it is popped first
+		int left = stack[top] + 1, right = node.first;
+		float tLeft, tRight;
+		bool hitLeft = hitBox(origin, invDir, bvh[left].lo, bvh[left].hi, t, tLeft);
+		bool hitRight = hitBox(origin, invDir, bvh[right].lo, bvh[right].hi, t, tRight);
+		if (hitLeft && hitRight && tLeft < tRight) {
+			stack[top] = right; enter[top++] = tRight;
+			stack[top] = left; enter[top++] = tLeft;
+		}
+		else {
+			if (hitLeft) { stack[top] = left; enter[top++] = tLeft; }
+			if (hitRight) { stack[top] = right; enter[top++] = tRight; }
+		}
+	}
+	return element_id >= 0;
+}
+
+// put back the emitted light only
+void StochasticSolver::reset() {
+	const SceneStore &Store = scene->store;
+	resetToEmission(Store, patchUnshot, elementRadiosity);
+	for (int e_id = 0; e_id < Store.numElements; e_id++)
+		elementVariance[e_id] = Color(0, 0, 0);
+	iteration = 0;
+	totalRays = 0;
+}
+
+double StochasticSolver::unshotPower() const {
+	return unshotPowerOf(scene->store, patchUnshot);
+}
+
+// trace the batches of one thread into its tally
+void StochasticSolver::shootBatches(int thread) {
+	const SceneStore &Store = scene->store;
+	Tally &tally = tallies[thread];
+
+	std::fill(tally.radiosity.begin(), tally.radiosity.end(), Color(0, 0, 0));
+	std::fill(tally.square.begin(), tally.square.end(), Color(0, 0, 0));
+	std::fill(tally.received.begin(), tally.received.end(), Color(0, 0, 0));
+
+	int64_t numRays = rayStart[Store.numPatches];
+	for (int batch = thread; batch < STOCHASTIC_BATCHES; batch += numThreads) {
+
+		uint64_t state = seed;
+		splitMix(state);
+		state ^= (uint64_t)iteration * 0xD1B54A32D192ED03ULL + (uint64_t)batch * 0x8CB92BA72F3D8DD7ULL;
+
+		int64_t first = numRays * batch / STOCHASTIC_BATCHES;
+		int64_t last = numRays * (batch + 1) / STOCHASTIC_BATCHES;
+		int p_id = (int)(std::upper_bound(rayStart.begin(), rayStart.end(), first) - rayStart.begin()) - 1;
+		vec3 u, v;
+		orthonormalBasis(Store.patchNormal[p_id], u, v);
+
+		for (int64_t ray = first; ray < last; ray++) {
+			if (ray >= rayStart[p_id + 1]) {
+				while (ray >= rayStart[p_id + 1]) p_id++;
+				orthonormalBasis(Store.patchNormal[p_id], u, v);
+			}
+
+			// 1. origin, uniform over the elements of the patch
+			uint32_t k0 = Store.patchElementStart[p_id], k1 = Store.patchElementStart[p_id + 1];
+			float pick = (float)uniform(state) * elementCdf[k1 - 1];
+			uint32_t k = (uint32_t)(std::upper_bound(elementCdf.begin() + k0, elementCdf.begin() + k1, pick) - elementCdf.begin());
+			const uint32_t *ev = &Store.elementVertices[4 * Store.patchElements[std::min(k, k1 - 1)]];
+			float s = (float)uniform(state), t = (float)uniform(state);
+			vec3 origin = Store.vertexPosition[ev[0]] * ((1 - s) * (1 - t)) + Store.vertexPosition[ev[1]] * (s * (1 - t))
+				+ Store.vertexPosition[ev[2]] * (s * t) + Store.vertexPosition[ev[3]] * ((1 - s) * t);
+
+			// 2. cosine weighted direction
+			double r = sqrt(uniform(state)), phi = 2 * PI * uniform(state);
+			float x = (float)(r * cos(phi)), y = (float)(r * sin(phi));
+			vec3 dir = u * x + v * y + Store.patchNormal[p_id] * (float)sqrt(std::max(0.0, 1 - r * r));
+
+			// 3. first element hit, from the front
+			int e_id;
+			if (!trace(origin, dir, p_id, e_id) || dot(dir, Store.elementNormal[e_id]) >= 0)
+				continue;
+
+			uint32_t patchJ = Store.elementPatch[e_id];
+			Color power = Store.patchReflectance[patchJ] * rayPower[p_id];
+			Color dRadiosity = power / (float)Store.elementArea[e_id];
+			tally.radiosity[e_id] += dRadiosity;
+			tally.square[e_id] += dRadiosity * dRadiosity;
+			tally.received[patchJ] += power / (float)Store.patchArea[patchJ];
+		}
+	}
+}
+
+// one stochastic Jacobi iteration
+void StochasticSolver::iterate(int numRays) {
+	const SceneStore &Store = scene->store;
+
+	// 1. rays per patch, in proportion to unshot power, at least one
+	//    for every patch that has some
+	double total = unshotPower();
+	if (total <= 0)
+		return;
+	rayStart.assign(Store.numPatches + 1, 0);
+	rayPower.resize(Store.numPatches);
+	for (int p_id = 0; p_id < Store.numPatches; p_id++) {
+		Color u = patchUnshot[p_id];
+		double power = (fabs(u.r) + fabs(u.g) + fabs(u.b)) * Store.patchArea[p_id];
+		int64_t n = (power > 0) ? (int64_t)ceil(numRays * power / total) : 0;
+		rayStart[p_id + 1] = rayStart[p_id] + n;
+		rayPower[p_id] = (n > 0) ? u * (float)(Store.patchArea[p_id] / n) : Color(0, 0, 0);
+	}
+
+	// 2. trace
+	vector<std::thread> workers;
+	for (int t = 1; t < numThreads; t++)
+		workers.push_back(std::thread(&StochasticSolver::shootBatches, this, t));
+	shootBatches(0);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	// 3. merge the tallies in thread order
+	int64_t shot = rayStart[Store.numPatches];
+	for (int p_id = 0; p_id < Store.numPatches; p_id++)
+		patchUnshot[p_id] = Color(0, 0, 0);
+	for (int t = 0; t < numThreads; t++)
+		for (int p_id = 0; p_id < Store.numPatches; p_id++)
+			patchUnshot[p_id] += tallies[t].received[p_id];
+
+	for (int e_id = 0; e_id < Store.numElements; e_id++) {
+		Color sum(0, 0, 0), square(0, 0, 0);
+		for (int t = 0; t < numThreads; t++) {
+			sum += tallies[t].radiosity[e_id];
+			square += tallies[t].square[e_id];
+		}
+		elementRadiosity[e_id] += sum;
+		// sample variance of the sum of 'shot' contributions
+		elementVariance[e_id] += glm::max(square - sum * sum / (float)shot, Color(0, 0, 0));
+	}
+
+	iteration++;
+	totalRays += shot;
+
+	if (printSteps)
+		cout << "Stochastic::iteration " << iteration << ", " << shot << " rays, unshot power "
+			<< unshotPower() << ", relative error " << relativeError() << endl;
+}
+
+// iterate until the unshot power drops below 'tolerance' of the emitted
+// power, or 'maxIterations'. returns the number of iterations
+int StochasticSolver::run(int raysPerIteration, int maxIterations, double tolerance) {
+	return runToTolerance(scene->store, patchUnshot, maxIterations, tolerance, [this, raysPerIteration] { iterate(raysPerIteration); });
+}
+
+// area weighted, as in compareShootingSchemes(). only the noise of the
+// rays an element received is counted, not the noise in the power
+// they were shot with
+double StochasticSolver::relativeError() const {
+	const SceneStore &Store = scene->store;
+	double variance = 0, norm = 0;
+	for (int e_id = 0; e_id < Store.numElements; e_id++) {
+		Color var = elementVariance[e_id], b = elementRadiosity[e_id];
+		variance += (var.r + var.g + var.b) * Store.elementArea[e_id];
+		norm += dot(b, b) * Store.elementArea[e_id];
+	}
+	return norm > 0 ? sqrt(variance / norm) : 0;
+}
+
+void StochasticSolver::updateVertexColor() {
+	averageAtVertices(scene->store, elementRadiosity, 0, vertexColor);
+}
@@ -0,0 +1,566 @@
+//**************************************************************************
+//
+//		Radiosity solver library
+//
+//		Scene loading, form factors and progressive refinement,
+//		without any window or GL context. A Scene is read only once
+//		loaded and can be shared; every Solver owns its own solution,
+//		so independent solves can run on different threads.
+//
+//		Scene scene;
+//		scene.load("scene.dat");
+//		Solver solver(scene);
+//		solver.generateFormFactors();		// or loadLookUpTable()
+//		solver.run(10000, 0.001);
+//
+//**************************************************************************
+
+#ifndef RADIOSITY_H
+#define RADIOSITY_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <stdio.h>
+#include "math.h"
+#include "glm/glm.hpp"
+
+const double HEMICUBE_HEIGHT 		= 1.0;
+const int HEMICUBE_SUBDIV 		= 512;
+const int HEMISPHERE_EDGE_SPLIT 	= 4;		// segments per edge when projecting onto the hemisphere
+const double PI 			= 3.141592;
+
+typedef glm::vec3 Color;
+typedef glm::vec3 Vertex;
+typedef glm::vec3 Vector;
+
+
+//		Scene		//
+
+// scene storage
+// every attribute is a column (SoA) carved out of one arena.
+// elements are stored along a Morton curve of their centers so that
+// neighbours in space are neighbours in memory; elementOrigId and
+// elementIndex map between storage order and file order.
+// all references are 32-bit indices into the columns.
+struct SceneStore {
+	char*		arena;			// single allocation holding every column
+
+	// vertices
+	int 		numVertices;
+	Vertex*		vertexPosition;
+
+	// patches
+	int 		numPatches;
+	uint32_t*	patchVertices;		// 4 per patch (index into vertexPosition)
+	Color*		patchEmissivity;	// emitted radiosity
+	Color*		patchReflectance;	// reflectance
+	Vertex*		patchCenter;		// center of the patch
+	Vector*		patchNormal;		// patch normal
+	double*		patchArea;		// area of the patch
+	uint32_t*	patchElementStart;	// numPatches + 1 offsets into patchElements
+	uint32_t*	patchElements;		// element storage indices, grouped by patch
+
+	// elements
+	int 		numElements;
+	uint32_t*	elementVertices;	// 4 per element (index into vertexPosition)
+	Vertex*		elementCenter;		// center of the element
+	Vector*		elementNormal;		// normal (same as its patch)
+	double*		elementArea;		// area of the element
+	uint32_t*	elementPatch;		// patch that this is an element of
+	uint32_t*	elementOrigId;		// storage index -> id in file order
+	uint32_t*	elementIndex;		// id in file order -> storage index
+
+	SceneStore() : arena(0), numVertices(0), numPatches(0), numElements(0) {}
+};
+
+// visibility class of a patch pair, see Scene::classifyPatchPairs()
+enum { PAIR_PARTIAL, PAIR_VISIBLE, PAIR_OCCLUDED };
+
+// geometry and materials, read only after load()
+class Scene {
+public:
+	SceneStore 	store;
+	uint64_t 	hash;		// identifies geometry and materials
+	bool 		printSteps;	// print load and visibility reports to cout
+
+	Scene() : hash(0), printSteps(false) {}
+	~Scene() { delete[] store.arena; }
+
+	// read a scene file, splitting each patch side into
+	// (its element count + extraSubdivision) elements
+	bool load(const std::string &fileName, int extraSubdivision = 2);
+
+	// PAIR_* of every patch pair, [i * numPatches + j]
+	void classifyPatchPairs(std::vector<unsigned char> &visibility) const;
+
+private:
+	Scene(const Scene&);
+	Scene& operator=(const Scene&);
+};
+
+
+//		Projection		//
+
+// local frame of a projector placed on a patch
+struct ProjectionFrame {
+	glm::vec3 center;
+	glm::vec3 normal;	// z-axis
+	glm::vec3 u, v;
+};
+
+// unoccluded form factor from a point to element 'element_id'
+double pointFormFactor(const SceneStore &store, const glm::vec3 &center, const glm::vec3 &normal, int element_id);
+
+// A projector is the policy plugged into ProjectionBuffer.
+// It provides
+//	NUM_FACES					number of render targets per patch
+//	faceSize(face, w, h)				resolution of each target
+//	faceOverlaps(face, corners)			false if a quad (local frame) surely misses the face
+//	itemBuffer(store, frame, face, candidates, ids)
+//							nearest element id per pixel, -1 : nothing
+//	deltaFormFactor(face, x, y)			form factor of pixel (x, y)
+// candidates[face] lists the elements that may show up on a face, and
+// are all a projector has to draw for it.
+
+// false if all corners of quad 'p' are outside one of the planes,
+// inside being dot(plane, q) >= 0
+inline bool frustumOverlaps(const float planes[][3], int numPlanes, const glm::vec3 p[4]) {
+	for (int k = 0; k < numPlanes; k++) {
+		int m = 0;
+		while (m < 4 && planes[k][0] * p[m].x + planes[k][1] * p[m].y + planes[k][2] * p[m].z < 0) m++;
+		if (m == 4) return false;
+	}
+	return true;
+}
+
+// hemisphere / Nusselt analog projector
+// elements are projected onto the unit hemisphere and then down onto
+// its base disk, where every pixel has the same form factor dA / PI.
+// the projection is not linear, so it is rasterized in software and
+// needs no GL context.
+struct HemisphereProjector {
+	static const int NUM_FACES = 1;
+
+	std::vector<float>	depthBuffer;	// distance to the nearest element per pixel
+
+	static void faceSize(int face, int &width, int &height) {
+		width = height = HEMICUBE_SUBDIV;
+	}
+
+	// the whole hemisphere, anything in front of the patch
+	static bool faceOverlaps(int face, const glm::vec3 p[4]) {
+		return true;
+	}
+
+	void itemBuffer(const SceneStore &store, const ProjectionFrame &frame, int face, const std::vector<int> &candidates, int32_t* ids);
+
+	static double deltaFormFactor(int face, int x, int y) {
+		double pixelSize = 2.0 / HEMICUBE_SUBDIV;
+		double _x = (x + 0.5) * pixelSize - 1;
+		double _y = (y + 0.5) * pixelSize - 1;
+		if (_x*_x + _y*_y > 1) return 0;	// outside of the base disk
+		return pixelSize * pixelSize / PI;
+	}
+
+private:
+	void rasterizeElement(const SceneStore &store, const ProjectionFrame &frame, int element_id, int32_t* ids);
+};
+
+// projection workspace, for any projector.
+// allocated once and reused for every patch: setPatch() places it on a
+// patch and gathers the candidates, render() fills one item buffer per
+// face, and updateLookUpTable() adds each pixel's precomputed delta
+// form factor to the element seen there.
+template <class Projector>
+class ProjectionBuffer {
+public:
+	const SceneStore *store;
+	ProjectionFrame frame;
+	Projector projector;
+	std::vector<int> candidates[Projector::NUM_FACES];	// elements each face has to draw
+	int faceStart[Projector::NUM_FACES + 1];		// first pixel of each face
+	std::vector<int32_t> itemBuffer;			// nearest element id per pixel, all faces
+	std::vector<double> pixelFormFactor;			// delta form factor per pixel, all faces
+
+	// construcors
+	ProjectionBuffer(const SceneStore &store_) : store(&store_) {
+		faceStart[0] = 0;
+		for (int face = 0; face < Projector::NUM_FACES; face++) {
+			int width, height;
+			Projector::faceSize(face, width, height);
+			faceStart[face + 1] = faceStart[face] + width * height;
+		}
+		itemBuffer.assign(faceStart[Projector::NUM_FACES], -1);
+
+		// delta form factors only depend on the pixel
+		pixelFormFactor.resize(faceStart[Projector::NUM_FACES]);
+		for (int face = 0; face < Projector::NUM_FACES; face++) {
+			int width, height;
+			Projector::faceSize(face, width, height);
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++)
+					pixelFormFactor[faceStart[face] + y * width + x] = Projector::deltaFormFactor(face, x, y);
+		}
+	}
+
+	// place the buffer on a patch. (u, v, normal) is made orthonormal,
+	// 'up' only has to be some direction not parallel to n
+	void setPatch(glm::vec3 c, glm::vec3 n, glm::vec3 up) {
+		frame.center = c;
+		frame.normal = n;
+		frame.u = glm::normalize(up - glm::dot(up, n) * n);
+		// generate vector v
+		frame.v = glm::cross(n, frame.u);
+		collectCandidates();
+	}
+
+	// elements in front of the patch, binned by the faces they may cover.
+	// whole patches behind the tangent plane or outside every face are
+	// dropped before their elements are looked at. the face tests are
+	// exact only in an orthonormal frame, as setPatch() builds it
+	void collectCandidates() {
+
+		const float eps = 1e-5f;
+		for (int face = 0; face < Projector::NUM_FACES; face++)
+			candidates[face].clear();
+
+		for (int p_id = 0; p_id < store->numPatches; p_id++) {
+
+			// 1. the patch
+			glm::vec3 local[4];
+			toLocal(&store->patchVertices[4 * p_id], local);
+			if (local[0].z <= eps && local[1].z <= eps && local[2].z <= eps && local[3].z <= eps)
+				continue;
+			unsigned patchFaces = 0;
+			for (int face = 0; face < Projector::NUM_FACES; face++)
+				if (Projector::faceOverlaps(face, local)) patchFaces |= 1 << face;
+			if (!patchFaces)
+				continue;
+
+			// 2. its elements
+			for (uint32_t k = store->patchElementStart[p_id]; k < store->patchElementStart[p_id + 1]; k++) {
+				int element_id = store->patchElements[k];
+				toLocal(&store->elementVertices[4 * element_id], local);
+				if (local[0].z <= eps && local[1].z <= eps && local[2].z <= eps && local[3].z <= eps)
+					continue;
+
+				for (int face = 0; face < Projector::NUM_FACES; face++)
+					if ((patchFaces & (1 << face)) && Projector::faceOverlaps(face, local))
+						candidates[face].push_back(element_id);
+			}
+		}
+	}
+
+	// quad corners in the frame of the patch (u, v, normal), all unit
+	// length and perpendicular
+	void toLocal(const uint32_t* vertices, glm::vec3 local[4]) const {
+		for (int m = 0; m < 4; m++) {
+			glm::vec3 p = store->vertexPosition[vertices[m]] - frame.center;
+			local[m] = glm::vec3(glm::dot(p, frame.u), glm::dot(p, frame.v), glm::dot(p, frame.normal));
+		}
+	}
+
+	// one item buffer per face, faces without candidates see nothing
+	void render() {
+		for (int SIDE = 0; SIDE < Projector::NUM_FACES; SIDE++) {
+			int32_t* ids = &itemBuffer[faceStart[SIDE]];
+			if (candidates[SIDE].empty())
+				std::fill(ids, ids + faceStart[SIDE + 1] - faceStart[SIDE], -1);
+			else
+				projector.itemBuffer(*store, frame, SIDE, candidates[SIDE], ids);
+		}
+	}
+
+	// add (not assign) the form factors to one row of the table
+	void updateLookUpTable(double* row) const {
+		const int32_t* ids = &itemBuffer[0];
+		const double* dFF = &pixelFormFactor[0];
+		for (int pix = 0; pix < faceStart[Projector::NUM_FACES]; pix++)
+			if (ids[pix] >= 0) row[ids[pix]] += dFF[pix];
+	}
+};
+
+
+//		Solver		//
+
+// storage of the form factor table.
+// packed rows keep one code per element and a per-row scale; the scale
+// is corrected after quantizing so every row keeps its exact sum, and
+// shooting conserves energy as with the double table. the correction
+// moves a whole row by one small factor (packTable() prints the errors
+// it measured). before it, the error of a single entry F, relative to
+// the row maximum Fmax, is:
+//	TABLE_HALF	fp16 of F / Fmax: relative 2^-11 (4.9e-4),
+//			absolute 2^-25 Fmax below 2^-14 Fmax
+//	TABLE_LOG16	log2 over 32 octaves: relative 1.7e-4,
+//			F below 2^-32 Fmax is dropped
+//	TABLE_LOG8	log2 over 16 octaves: relative 2.2%,
+//			F below 2^-16 Fmax is dropped
+enum { TABLE_DOUBLE, TABLE_HALF, TABLE_LOG16, TABLE_LOG8 };
+
+// unshot tag structure
+// stores unshot, used for putting it in priority queue
+struct UnshotTag {
+	Color unshot;
+	int id;
+
+	UnshotTag(Color unshot_, int id_) : unshot(unshot_), id(id_) {}
+} ;
+
+// unshot tag comparison method for priority queue
+struct CompareTag {
+	// comparison operator
+	// for priority queue
+	bool operator ()(const UnshotTag &p1, const UnshotTag &p2) const {
+		double p1Size = p1.unshot.r * p1.unshot.r + p1.unshot.g * p1.unshot.g + p1.unshot.b * p1.unshot.b;
+		double p2Size = p2.unshot.r * p2.unshot.r + p2.unshot.g * p2.unshot.g + p2.unshot.b * p2.unshot.b;
+
+		if (p1Size < p2Size){ return true; }
+		else{ return false; }
+	}
+};
+
+// progressive refinement solution of one scene.
+// not thread safe itself; one thread per Solver
+class Solver {
+public:
+	Solver(const Scene &scene);
+	~Solver();
+
+	// form factors
+	template <class Projector>
+	void computeFormFactors();
+	void generateFormFactors();		// hemisphere projector, no GL needed
+	bool loadLookUpTable(const std::string &fileName);
+	bool writeLookUpTable(const std::string &fileName) const;
+	void reportFormFactorConsistency() const;
+
+	// packed table
+	void packTable(int format);		// TABLE_*, TABLE_DOUBLE unpacks
+	const double* formFactorRow(int patch_id, std::vector<double> &scratch) const;
+	bool saveFormFactorCache(const std::string &fileName) const;
+	bool loadFormFactorCache(const std::string &fileName);
+
+	// solving
+	void reset();				// emitted light only
+	void step();				// one progressive refinement step
+	int run(int maxSteps, double tolerance);	// until unshot power < tolerance * emitted power
+	double unshotPower() const;
+	Color computeAmbient() const;
+	void updateVertexColor(bool addAmbient);
+	void compareShootingSchemes();
+
+	// checkpoint
+	bool saveCheckpoint(const std::string &fileName);
+	bool loadCheckpoint(const std::string &fileName);
+
+	// frame log
+	bool openFrameLog(const std::string &fileName);
+	bool frameLogOpen() const { return frameLog != 0; }
+	void logFrame();
+	void closeFrameLog();
+
+	const Scene 	*scene;
+	double** 	lookUpTable;		// [patch][element storage index], rows are 0 while packed
+	uint64_t 	formFactorHash;		// identifies the form factor table in lookUpTable
+	int 		tableFormat;		// TABLE_*
+	unsigned char* 	packedTable;		// [patch][element storage index] codes
+	double* 	packedScale;		// per row scale of the codes
+
+	// solution columns
+	char* 		arena;
+	Color* 		elementRadiosity;	// radiosity of the element
+	Color* 		patchUnshot;		// unshot radiosity of the patch
+	Color* 		vertexColor;		// averaged element radiosity per vertex
+
+	// Ambient term variables
+	Color 		reflectionFactor;	// overall interreflection factor R
+	Color 		ambient;		// total ambient factor
+	Color 		dAmbient;		// chance in ambience
+
+	int 		totalStep;
+	int 		currentPatchID;
+	bool 		overshooting;		// Feda & Purgathofer overshooting
+	bool 		shaftCulling;		// project only partially occluded patch pairs, off by default
+	bool 		printSteps;		// print progress to cout
+
+private:
+	std::priority_queue<UnshotTag, std::vector<UnshotTag>, CompareTag> unshotPatchQueue;
+
+	// checkpoint writer
+	std::thread 		checkpointThread;
+	std::mutex 		checkpointMutex;
+	std::condition_variable checkpointWake;
+	std::vector<char>* 	checkpointPending;	// encoded state waiting to be written
+	std::string 		checkpointName;
+	bool 			checkpointBusy;		// a write is queued or in flight
+	bool 			checkpointQuit;
+
+	// frame log writer
+	FILE* 			frameLog;
+	std::vector<Color> 	frameLogLast;		// radiosity at the last frame, file order
+	std::thread 		frameLogThread;
+	std::mutex 		frameLogMutex;
+	std::condition_variable frameLogWake;
+	std::queue<std::vector<char>*> frameLogQueue;	// encoded frames waiting to be written
+	bool 			frameLogQuit;
+
+	void updatePriorityQueue();
+	template <class Row>
+	void shoot(int patch_id, Color unshot, const Row &Fi);
+	void patchFormFactors(int patch_id, std::vector<double> &Fij) const;
+	uint64_t computeFormFactorHash() const;
+	void unpackTable();
+	void checkpointLoop();
+	void waitCheckpoint();
+	void frameLogLoop();
+
+	Solver(const Solver&);
+	Solver& operator=(const Solver&);
+};
+
+// compute form factor of entire scene with the given projector
+template <class Projector>
+void Solver::computeFormFactors() {
+
+	const SceneStore &Store = scene->store;
+	unpackTable();
+
+	// pairs that shaft culling settles need no projection
+	std::vector<unsigned char> visibility;
+	if (shaftCulling)
+		scene->classifyPatchPairs(visibility);
+
+	// up vectors for hemicube
+	glm::vec3 up(0, 0, 1);		// towards upper direction of scene
+	glm::vec3 toCam(1, 0, 0);	// towards the camera
+
+	// one workspace for all patches
+	ProjectionBuffer<Projector> hemicube(Store);
+	std::vector<unsigned char> project(Store.numElements);
+
+	// for all patches
+	for (int patch_id = 0; patch_id < Store.numPatches; patch_id++) {
+
+		if (printSteps)
+			std::cout << "GenFormFactors::computing patch " << patch_id << "/" << Store.numPatches << "..." << std::endl;
+
+		// elements whose form factor comes from the projection
+		int numProjected = 0;
+		for (int element_id = 0; element_id < Store.numElements; element_id++) {
+			project[element_id] = !(shaftCulling && visibility[patch_id * Store.numPatches + Store.elementPatch[element_id]] != PAIR_PARTIAL);
+			numProjected += project[element_id];
+		}
+
+		double* row = lookUpTable[patch_id];
+		for (int element_id = 0; element_id < Store.numElements; element_id++)
+			row[element_id] = 0;
+
+		// place hemicube on the patch, depends on wall direction.
+		// every candidate is drawn as an occluder, only the elements
+		// above keep what they collect
+		if (numProjected) {
+			bool facingUp = fabs(glm::dot(Store.patchNormal[patch_id], up)) > 0.9f;
+			hemicube.setPatch(Store.patchCenter[patch_id], Store.patchNormal[patch_id], facingUp ? toCam : up);
+			hemicube.render();
+			hemicube.updateLookUpTable(row);
+		}
+
+		for (int element_id = 0; element_id < Store.numElements; element_id++) {
+			if (project[element_id])
+				continue;
+			// fully visible pairs, analytic
+			if (shaftCulling && visibility[patch_id * Store.numPatches + Store.elementPatch[element_id]] == PAIR_VISIBLE)
+				row[element_id] = pointFormFactor(Store, Store.patchCenter[patch_id], Store.patchNormal[patch_id], element_id);
+			else
+				row[element_id] = 0;
+		}
+	}
+
+	formFactorHash = computeFormFactorHash();
+	reportFormFactorConsistency();
+}
+
+
+//		Stochastic Solver		//
+
+const int STOCHASTIC_BATCHES = 256;	// ray batches per iteration, each with its own random stream
+
+// Monte Carlo radiosity without a form factor table (stochastic Jacobi
+// iterations, Bekaert et al.). every iteration shoots the unshot power
+// of all patches at once as rays: each patch gets rays in proportion to
+// its unshot power, origins are uniform over its elements and directions
+// are cosine weighted. a ray hands its power, times the reflectance, to
+// the first element it hits (through a BVH over the elements), which
+// passes it on in the next iteration. memory grows with the number of
+// elements only, accuracy with the number of rays.
+//
+// rays are cut into STOCHASTIC_BATCHES batches, each seeded from
+// (seed, iteration, batch), and batch b always runs on thread
+// b % numThreads, so a run repeats exactly for the same seed and
+// thread count.
+class StochasticSolver {
+public:
+	StochasticSolver(const Scene &scene, int numThreads = 0);	// 0 : one per core
+	~StochasticSolver();
+
+	void reset();				// emitted light only
+	void iterate(int numRays);		// shoot all unshot power with about 'numRays' rays
+	int run(int raysPerIteration, int maxIterations, double tolerance);	// until unshot power < tolerance * emitted power
+	double unshotPower() const;
+	double relativeError() const;		// area weighted RMS standard error / RMS radiosity
+	void updateVertexColor();
+
+	const Scene 	*scene;
+	uint64_t 	seed;
+	int 		numThreads;
+	int 		iteration;
+	int64_t 	totalRays;
+	bool 		printSteps;		// print progress to cout
+
+	// solution columns
+	char* 		arena;
+	Color* 		elementRadiosity;	// radiosity of the element
+	Color* 		elementVariance;	// variance of that estimate, from the rays it received
+	Color* 		patchUnshot;		// unshot radiosity of the patch
+	Color* 		vertexColor;		// averaged element radiosity per vertex
+
+private:
+	struct BVHNode {
+		glm::vec3 lo, hi;	// bounds
+		int32_t first;		// leaf : first entry in bvhElements, inner : right child
+		int32_t count;		// leaf : number of elements, inner : 0 (left child follows)
+	};
+
+	// what one thread collects during an iteration
+	struct Tally {
+		std::vector<Color> radiosity;	// per element, sum of contributions
+		std::vector<Color> square;	// per element, sum of squared contributions
+		std::vector<Color> received;	// per patch, unshot radiosity for the next iteration
+	};
+
+	std::vector<BVHNode> 	bvh;
+	std::vector<int32_t> 	bvhElements;	// element ids in leaf order
+	std::vector<float> 	elementCdf;	// running area per patch, along patchElements
+	float 			rayEpsilon;	// shortest hit distance
+	std::vector<Tally> 	tallies;	// one per thread
+	std::vector<int64_t> 	rayStart;	// first ray of each patch this iteration, numPatches + 1
+	std::vector<Color> 	rayPower;	// power each ray of a patch carries this iteration
+
+	int buildNode(std::vector<glm::vec3> &centers, int first, int count);
+	bool trace(glm::vec3 origin, glm::vec3 dir, int ignorePatch, int &element_id) const;
+	void shootBatches(int thread);
+
+	StochasticSolver(const StochasticSolver&);
+	StochasticSolver& operator=(const StochasticSolver&);
+};
+
+#endif
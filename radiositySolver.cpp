@@ -16,34 +16,41 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <queue>
 #include <time.h>
-#include "math.h"
-#include "GL\glui.h"
-#include "glm\glm.hpp"
-#include "GL\glut.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <GL/glui.h>
+#include "radiosity.h"
+#include <GL/glut.h>
+#ifdef FREEGLUT
+#include <GL/freeglut_ext.h>	// glutGetProcAddress
+#endif
 
 using namespace std;
 using namespace glm;
 
-#define HEMICUBE_HEIGHT 1.0
-#define HEMICUBE_SUBDIV 512
-#define PI 3.141592
+#define SINGLEPLANE_EXTENT 3.0		// half width of the single plane (in hemicube heights)
+#define SINGLEPLANE_NEAR 0.01		// near plane of the single plane view, in scene units
+#define SINGLEPLANE_FAR 1000.0
 
-typedef vec3 Color;
-typedef vec3 Vertex;
-typedef vec3 Vector;
 enum { FRONT, LEFT, RIGHT, TOP, BOTTOM };
+enum { PROJ_HEMICUBE, PROJ_SINGLEPLANE, PROJ_HEMISPHERE };
 
 
 //		Global Variables		//
 
 //	GLUI Variables
 GLUI		 *glui;
-GLUI_Panel	 *panel_control;
-GLUI_Button	 *button_genFF, *button_doPR;
-GLUI_Checkbox	 *cbox_showCurrentPatch, *cbox_showAmient, *cbox_smoothShade;
-GLUI_Spinner	 *spinner_iterationLevel;
+GLUI_Panel	 *panel_control, *panel_projector, *panel_table, *panel_checkpoint, *panel_stochastic;
+GLUI_Button	 *button_genFF, *button_doPR, *button_cancelPR, *button_compare, *button_saveCkpt, *button_loadCkpt, *button_saveCache, *button_stochastic;
+GLUI_Checkbox	 *cbox_showCurrentPatch, *cbox_showAmient, *cbox_smoothShade, *cbox_pause, *cbox_overshoot, *cbox_shaftCulling;
+GLUI_Spinner	 *spinner_iterationLevel, *spinner_checkpoint, *spinner_frameLog, *spinner_stochasticRays;
+GLUI_RadioGroup	 *radio_projector, *radio_table;
 
 // IDs for callbacks
 #define CB_UNSHOTPATCH_ID	100
@@ -52,372 +59,222 @@ GLUI_Spinner	 *spinner_iterationLevel;
 #define SPIN_ITERATE_ID		103
 #define BTN_GENFF		104
 #define BTN_RUNPR		105
-
-// Ambient term variables
-Color reflectionFactor;	// overall interreflection factor R
-Color ambient;		// total ambient factor
-Color dAmbient;		// chance in ambience
+#define BTN_SAVECKPT		106
+#define BTN_LOADCKPT		107
+#define CB_PAUSE_ID		108
+#define BTN_CANCELPR		109
+#define BTN_COMPARE		110
+#define RB_TABLE_ID		111
+#define BTN_SAVECACHE		112
+#define BTN_STOCHASTIC		113
+#define CB_OVERSHOOT_ID		114
+#define SPIN_CHECKPOINT_ID	115
+#define SPIN_FRAMELOG_ID	116
 
 // Global Control Variables
 int mainWindow;
-int totalStep 			= 0;
-int currentPatchID;
 int numOfIteration 		= 1;
 int displayCurrentShotPatch 	= true;
 int showAmbient 		= true;
 int smoothShade 		= true;
+int projectorType 		= PROJ_HEMICUBE;
+int overshooting 		= false;
+int shaftCulling 		= false;
+int tableStorage 		= TABLE_DOUBLE;	// TABLE_* of the form factor table
+int extraSubdivision 		= 2;	// extra elements per patch side ( -subdiv N )
+int stochasticRays 		= 500;	// thousands of rays per Monte Carlo iteration
+
+Scene 	scene;			// loaded once in init()
+Solver* solver 	= 0;		// solution shown in the window
+const SceneStore &Store = scene.store;
+
+// render one view of the candidates, each in a colour that encodes its
+// id + 1 (0 : background), then read it back into the item buffer 'ids'.
+// left, right, bottom and top are measured on the near plane, as in
+// glFrustum. 'rgb' is the projector's read back scratch
+void renderItemBuffer(const SceneStore &Store, const ProjectionFrame &frame, int width, int height,
+	float left, float right, float bottom, float top, float nearDist, float farDist, vec3 lookat, vec3 up,
+	const vector<int> &candidates, int32_t* ids, vector<unsigned char> &rgb) {
+
+	const vec3 &center = frame.center;
+
+	glViewport(0, 0, width, height);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glFrustum(left, right, bottom, top, nearDist, farDist);
+	gluLookAt(center.x, center.y, center.z, lookat.x, lookat.y, lookat.z, up.x, up.y, up.z);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
 
-
-//		Structures		//
-
-// patch structure
-typedef struct {
-	int 	id;
-	int 	vertices[4];	// array of vertices (index into VertexArray)
-	Color 	emissivity;	// emitted radiosity
-	Color 	reflectance;	// reflectance
-	Vertex 	center;		// center of the patch
-	Vector 	normal;		// patch normal
-	double 	area;		// area of the patch
-	Color 	radiosity;	// radiosity of the patch
-	Color 	unshot;		// unshot radiosity of the patch
-	int 	numelements;	// number of elements in patch
-	int 	startelement;	// number of first element for this patch in ElementArray
-
-} Patch;
-
-// element structure
-typedef struct {
-	int 	id;
-	int 	vertices[4];	// vertices of patch (index into VertexArray)
-	Vertex 	center;		// center of the element
-	double 	area;		// area of the element
-	Patch* 	patch;		// Patch that this is an element of
-	Color 	radiosity;	// radiosity of the element
-} Element;
-
-// unshot tag structure
-// stores unshot, used for putting it in priority queue
-struct UnshotTag {
-	Color unshot;
-	int id;
-
-	UnshotTag(Color unshot_, int id_) : unshot(unshot_), id(id_) {}
-} ;
-
-// unshot tag comparison method for priority queue
-struct CompareTag {
-	// comparison operator
-	// for priority queue
-	bool operator ()(const UnshotTag &p1, const UnshotTag &p2) const {
-		double p1Size = p1.unshot.r * p1.unshot.r + p1.unshot.g * p1.unshot.g + p1.unshot.b * p1.unshot.b;
-		double p2Size = p2.unshot.r * p2.unshot.r + p2.unshot.g * p2.unshot.g + p2.unshot.b * p2.unshot.b;
-		
-		if (p1Size < p2Size){ return true; }
-		else{ return false; }
+	// ids have to come back exactly
+	glDisable(GL_DITHER);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glBegin(GL_QUADS);
+	for (size_t i = 0; i < candidates.size(); i++) {
+		int code = candidates[i] + 1;
+		glColor3ub(code & 0xFF, (code >> 8) & 0xFF, (code >> 16) & 0xFF);
+
+		const uint32_t *ev = &Store.elementVertices[4 * candidates[i]];
+		glVertex3f(Store.vertexPosition[ev[0]].x, Store.vertexPosition[ev[0]].y, Store.vertexPosition[ev[0]].z);
+		glVertex3f(Store.vertexPosition[ev[1]].x, Store.vertexPosition[ev[1]].y, Store.vertexPosition[ev[1]].z);
+		glVertex3f(Store.vertexPosition[ev[2]].x, Store.vertexPosition[ev[2]].y, Store.vertexPosition[ev[2]].z);
+		glVertex3f(Store.vertexPosition[ev[3]].x, Store.vertexPosition[ev[3]].y, Store.vertexPosition[ev[3]].z);
 	}
-};
-
-// Array buffers
-int 	 NumVertices;
-Vertex*  VertexArray;
-Color* 	 VertexColors;
-int 	 NumPatches;
-Patch* 	 PatchArray;
-int 	 NumElements;
-Element* ElementArray;
-double** lookUpTable;
-priority_queue<UnshotTag, vector<UnshotTag>, CompareTag> unshotPatchQueue;
-
-class Hemicube {
-
-	struct HemiPixel {
-		double formFactor;	// total form factor stored in pixel
-		vector<int> id;		// list of element id that is projected
-
-		HemiPixel() { formFactor = 0; }
-	};
-
-public: 
-	vec3 center;
-	vec3 normal;	// z-axis
-	vec3 u, v;
-	vector<HemiPixel*> hemiPixel;
-	// construcors
-	Hemicube() {};
-	Hemicube(vec3 c, vec3 n, vec3 up) : center(c), normal(n), u(up) {
-
-		// generate vector v
-		v = cross(normal, u);
-		// generate hemipixel set
-		hemiPixel.push_back(new HemiPixel[HEMICUBE_SUBDIV * HEMICUBE_SUBDIV]);		// front face
-		hemiPixel.push_back(new HemiPixel[HEMICUBE_SUBDIV * HEMICUBE_SUBDIV / 2]);	// side face
-		hemiPixel.push_back(new HemiPixel[HEMICUBE_SUBDIV * HEMICUBE_SUBDIV / 2]);
-		hemiPixel.push_back(new HemiPixel[HEMICUBE_SUBDIV * HEMICUBE_SUBDIV / 2]);
-		hemiPixel.push_back(new HemiPixel[HEMICUBE_SUBDIV * HEMICUBE_SUBDIV / 2]);
-	}
-	~Hemicube() { for(int i=0; i<5; i++) delete[] hemiPixel[i]; }	// so important. or else it eats so much memory during runtime
-
-	void computeDeltaFormFactor(Element element, int element_id) {
-		for (int SIDE = 0; SIDE < 5; SIDE++) {
-
-			int width, height;
-			float left, right, bottom, top;
-			vec3 lookat, up;
-
-			// 1. set OpenGL viewport
-			switch (SIDE) {
-			case FRONT:
-				width 	= height = HEMICUBE_SUBDIV;
-				left 	= - HEMICUBE_HEIGHT;
-				right 	= HEMICUBE_HEIGHT;
-				bottom	= -HEMICUBE_HEIGHT;
-				top 	= HEMICUBE_HEIGHT;
-				lookat 	= center + normal;
-				up 	= u;
-				break;
-			case TOP:
-				width 	= HEMICUBE_SUBDIV;
-				height 	= HEMICUBE_SUBDIV / 2;
-				left 	= -HEMICUBE_HEIGHT;
-				right 	= HEMICUBE_HEIGHT;
-				bottom 	= 0;
-				top 	= HEMICUBE_HEIGHT;
-				lookat 	= center + u;
-				up 	= normal;
-				break;
-			case RIGHT:
-				width 	= HEMICUBE_SUBDIV;
-				height 	= HEMICUBE_SUBDIV / 2;
-				left 	= -HEMICUBE_HEIGHT;
-				right 	= HEMICUBE_HEIGHT;
-				bottom 	= 0;
-				top 	= HEMICUBE_HEIGHT;
-				lookat 	= center + v;
-				up 	= normal;
-				break;
-			case BOTTOM:
-				width 	= HEMICUBE_SUBDIV;
-				height 	= HEMICUBE_SUBDIV / 2;
-				left 	= -HEMICUBE_HEIGHT;
-				right 	= HEMICUBE_HEIGHT;
-				bottom 	= 0;
-				top 	= HEMICUBE_HEIGHT;
-				lookat 	= center - u;
-				up 	= normal;
-				break;
-			case LEFT:
-				width 	= HEMICUBE_SUBDIV;
-				height 	= HEMICUBE_SUBDIV / 2;
-				left 	= -HEMICUBE_HEIGHT;
-				right 	= HEMICUBE_HEIGHT;
-				bottom 	= 0;
-				top 	= HEMICUBE_HEIGHT;
-				lookat 	= center - v;
-				up 	= normal;
-				break;
-			}
+	glEnd();
+	glEnable(GL_DITHER);
+
+	// read render data
+	rgb.resize(3 * width * height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rgb[0]);
+	for (int i = 0; i < width * height; i++)
+		ids[i] = (rgb[3 * i] | (rgb[3 * i + 1] << 8) | (rgb[3 * i + 2] << 16)) - 1;
+}
 
-			// 2. render element to plane
-			// element will be colored white
-
-			glViewport(0, 0, width, height);
-			glMatrixMode(GL_PROJECTION);
-			glLoadIdentity();
-			glFrustum(left, right, bottom, top, HEMICUBE_HEIGHT, 10000);
-			gluLookAt(center.x, center.y, center.z, lookat.x, lookat.y, lookat.z, up.x, up.y, up.z);
-			glMatrixMode(GL_MODELVIEW);
-			glLoadIdentity();
-
-			// render current element white
-			// everything else black.
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			glBegin(GL_QUADS);
-			for (int id = 0; id < NumElements; id++) {
-				
-				if (id == element_id) glColor3f(1, 1, 1);
-				else glColor3d(0, 0, 0);
-				
-				glVertex3f(VertexArray[ElementArray[id].vertices[0]].x, VertexArray[ElementArray[id].vertices[0]].y, VertexArray[ElementArray[id].vertices[0]].z);
-				glVertex3f(VertexArray[ElementArray[id].vertices[1]].x, VertexArray[ElementArray[id].vertices[1]].y, VertexArray[ElementArray[id].vertices[1]].z);
-				glVertex3f(VertexArray[ElementArray[id].vertices[2]].x, VertexArray[ElementArray[id].vertices[2]].y, VertexArray[ElementArray[id].vertices[2]].z);
-				glVertex3f(VertexArray[ElementArray[id].vertices[3]].x, VertexArray[ElementArray[id].vertices[3]].y, VertexArray[ElementArray[id].vertices[3]].z);
-			}
-			glEnd();
-			
-			// read render data
-			unsigned char* pixel = new unsigned char[width * height * 3];
-			glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixel);
-
-			// 3. find projected pixels
-			//	  and save dFormFactor, update list of patch id in pixel
-			for (int y = 0; y < height; y++) {			// for each row y
-				for (int x = 0; x < width; x++) {		// each x in row
-					int index = (y * width + x) * 3;
-
-					if ((int)pixel[index] > 0) {	// if pixel is colored(projected)
-						if (SIDE == FRONT) {
-							// compute delta form factor
-							double _y = (double)(y - height / 2) / HEMICUBE_SUBDIV;	// normalize to 1
-							double _x = (double)(x - width / 2) / HEMICUBE_SUBDIV;	// normalize to 1
-							double r = sqrt(_x*_x + _y*_y + HEMICUBE_HEIGHT);
-							double dArea = 1.f / (HEMICUBE_SUBDIV * HEMICUBE_SUBDIV);
-							double dFormFactor = (1 / (PI * pow(r , 4))) * dArea;	// THE LEGENDARY DELTA FORMFACTOR
-
-							// add deltaFormfactor
-							hemiPixel[SIDE][index/3].formFactor += dFormFactor;
-							// add id
-							hemiPixel[SIDE][index/3].id.push_back(element_id);
-						}						
-						else {
-							// compute delta form factor
-							double _y = (double)y / HEMICUBE_SUBDIV;				// normalize to 1
-							double _x = (double)(x - width / 2) / HEMICUBE_SUBDIV;	// normalize to 1
-							double r = sqrt(_x*_x + _y*_y + HEMICUBE_HEIGHT);
-							double dArea = 1.f / (HEMICUBE_SUBDIV * HEMICUBE_SUBDIV /2);
-							double dFormFactor = (_y / (PI * pow(r, 4))) * dArea;	// THE LEGENDARY DELTA FORMFACTOR
-
-							// add deltaFormfactor
-							hemiPixel[SIDE][index/3].formFactor += dFormFactor;
-							// add id
-							hemiPixel[SIDE][index/3].id.push_back(element_id);
-						}
-					}
-				}
-			}
-			// delete memory.
-			delete[] pixel;
-		}
-	}
 
-	void updateLookUpTable(int patch_id) {
-		
-		// for every pixel,
-		// pull id from vector
-		// and 'add'(not assign) ff to table
+//		Projectors		//
+//
+// GL projectors for ProjectionBuffer (see radiosity.h), they need the
+// window's context. the hemisphere projector lives in the library.
 
-		for (int SIDE = 0; SIDE < 5; SIDE++) {
-			if (SIDE == FRONT) {
-				for (int pix = 0; pix < HEMICUBE_SUBDIV*HEMICUBE_SUBDIV; pix++) {
-					while (int size = hemiPixel[SIDE][pix].id.size() > 0) {
-						int element_id = hemiPixel[SIDE][pix].id[size - 1];	// get last element (id)
-						hemiPixel[SIDE][pix].id.pop_back();					// remove last element
+// classic five face hemicube (Cohen & Greenberg, 1985)
+struct HemicubeProjector {
+	static const int NUM_FACES = 5;
 
-						// update look up table
-						lookUpTable[patch_id][element_id] += hemiPixel[SIDE][pix].formFactor;
-					}
-				}
-			}
-			else {
-				for (int pix = 0; pix < HEMICUBE_SUBDIV*HEMICUBE_SUBDIV/2; pix++) {
-					while (int size = hemiPixel[SIDE][pix].id.size() > 0) {
-						int element_id = hemiPixel[SIDE][pix].id[size - 1];	// get last element (id)
-						hemiPixel[SIDE][pix].id.pop_back();					// remove last element
-
-						// update look up table
-						lookUpTable[patch_id][element_id] += hemiPixel[SIDE][pix].formFactor;
-					}
-				}
-			}
-		}
+	static void faceSize(int face, int &width, int &height) {
+		width = HEMICUBE_SUBDIV;
+		height = (face == FRONT) ? HEMICUBE_SUBDIV : HEMICUBE_SUBDIV / 2;
 	}
-};
-
-
 
-//		Functions		//
-
-// update priority queue
-void updatePriorityQueue() {
-
-	// reset priority queue
-	while (!unshotPatchQueue.empty())
-		unshotPatchQueue.pop();
-
-	for (int id = 0; id < NumPatches; id++) {
-		UnshotTag unshot(PatchArray[id].unshot, id);
-		unshotPatchQueue.push(unshot);
+	// face frusta in the local frame (u, v, normal). the front face
+	// looks along the normal, side faces along +-u, +-v and only
+	// reach up from the tangent plane
+	static bool faceOverlaps(int face, const vec3 p[4]) {
+		static const float planes[5][4][3] = {
+			{ { -1,  0,  1 }, {  1,  0,  1 }, {  0, -1,  1 }, {  0,  1,  1 } },	// FRONT
+			{ { -1, -1,  0 }, {  1, -1,  0 }, {  0, -1, -1 }, {  0,  0,  1 } },	// LEFT	  (-v)
+			{ { -1,  1,  0 }, {  1,  1,  0 }, {  0,  1, -1 }, {  0,  0,  1 } },	// RIGHT  (+v)
+			{ {  1, -1,  0 }, {  1,  1,  0 }, {  1,  0, -1 }, {  0,  0,  1 } },	// TOP	  (+u)
+			{ { -1, -1,  0 }, { -1,  1,  0 }, { -1,  0, -1 }, {  0,  0,  1 } },	// BOTTOM (-u)
+		};
+		return frustumOverlaps(planes[face], 4, p);
 	}
-}
 
-// ** Do one step of Progressive Refinement ** //
-void progressiveRefinement() {
-
-
-	// get the most unshot patch (from priority queue)
-	UnshotTag unshotTag = unshotPatchQueue.top();
-	int mostUnshotID = unshotTag.id;
-	currentPatchID = mostUnshotID;
-
-	for (int element_id = 0; element_id < NumElements; element_id++) {
-
-		// 1. determine increase in radiosity of element e due to Bi
-
-		Color dRadiosity;
+	vector<unsigned char> rgb;	// read back scratch
+
+	void itemBuffer(const SceneStore &store, const ProjectionFrame &frame, int face, const vector<int> &candidates, int32_t* ids) {
+
+		int width, height;
+		float left, right, bottom, top;
+		vec3 lookat, up;
+
+		// set OpenGL viewport
+		faceSize(face, width, height);
+		left 	= -HEMICUBE_HEIGHT;
+		right 	= HEMICUBE_HEIGHT;
+		bottom 	= 0;
+		top 	= HEMICUBE_HEIGHT;
+		up 	= frame.normal;
+		switch (face) {
+		case FRONT:
+			bottom	= -HEMICUBE_HEIGHT;
+			lookat 	= frame.center + frame.normal;
+			up 	= frame.u;
+			break;
+		case TOP:
+			lookat 	= frame.center + frame.u;
+			break;
+		case RIGHT:
+			lookat 	= frame.center + frame.v;
+			break;
+		case BOTTOM:
+			lookat 	= frame.center - frame.u;
+			break;
+		case LEFT:
+			lookat 	= frame.center - frame.v;
+			break;
+		}
 
-		Color reflectivity = ElementArray[element_id].patch->reflectance;
-		Color unshot = PatchArray[mostUnshotID].unshot;
-		double Fie = lookUpTable[mostUnshotID][element_id];
-		double Ai = PatchArray[mostUnshotID].area;
-		double Ae = ElementArray[element_id].area;
-		double Aj = ElementArray[element_id].patch->area;
+		renderItemBuffer(store, frame, width, height, left, right, bottom, top, HEMICUBE_HEIGHT, 10000, lookat, up, candidates, ids, rgb);
+	}
 
-		dRadiosity.r = reflectivity.r * unshot.r * Fie * (Ai / Ae);
-		dRadiosity.g = reflectivity.g * unshot.g * Fie * (Ai / Ae);
-		dRadiosity.b = reflectivity.b * unshot.b * Fie * (Ai / Ae);
+	static double deltaFormFactor(int face, int x, int y) {
+		int width, height;
+		faceSize(face, width, height);
 
+		if (face == FRONT) {
+			double _y = (double)(y - height / 2) / HEMICUBE_SUBDIV;	// normalize to 1
+			double _x = (double)(x - width / 2) / HEMICUBE_SUBDIV;	// normalize to 1
+			double r = sqrt(_x*_x + _y*_y + HEMICUBE_HEIGHT);
+			double dArea = 1.f / (HEMICUBE_SUBDIV * HEMICUBE_SUBDIV);
+			return (1 / (PI * pow(r , 4))) * dArea;		// THE LEGENDARY DELTA FORMFACTOR
+		}
+		else {
+			double _y = (double)y / HEMICUBE_SUBDIV;				// normalize to 1
+			double _x = (double)(x - width / 2) / HEMICUBE_SUBDIV;	// normalize to 1
+			double r = sqrt(_x*_x + _y*_y + HEMICUBE_HEIGHT);
+			double dArea = 1.f / (HEMICUBE_SUBDIV * HEMICUBE_SUBDIV /2);
+			return (_y / (PI * pow(r, 4))) * dArea;		// THE LEGENDARY DELTA FORMFACTOR
+		}
+	}
+};
 
-		// 2. add area weighted portion of of increased radiosity of element e
-		//	  to radiosity of the patch j which contains element e
+// single projection plane (Sillion & Puech, 1989)
+// one render per patch. the plane only reaches SINGLEPLANE_EXTENT,
+// so the grazing band near the horizon is lost; every pixel is scaled
+// by 1 / (form factor of the plane) to put that energy back.
+struct SinglePlaneProjector {
+	static const int NUM_FACES = 1;
 
-		Color *unshotJ = &ElementArray[element_id].patch->unshot;		// element's patch
-		ElementArray[element_id].radiosity = ElementArray[element_id].radiosity + dRadiosity;	/// reflectivity * dAmbient; <- This(Ambient term) is just for display. Should not be added here
-		unshotJ->r = unshotJ->r + dRadiosity.r*(Ae / Aj);
-		unshotJ->g = unshotJ->g + dRadiosity.g*(Ae / Aj);
-		unshotJ->b = unshotJ->b + dRadiosity.b*(Ae / Aj);
+	static void faceSize(int face, int &width, int &height) {
+		width = height = HEMICUBE_SUBDIV;
+	}
 
+	static bool faceOverlaps(int face, const vec3 p[4]) {
+		static const float e = (float)SINGLEPLANE_EXTENT;
+		static const float planes[4][3] = { { -1, 0, e }, { 1, 0, e }, { 0, -1, e }, { 0, 1, e } };
+		return frustumOverlaps(planes, 4, p);
 	}
 
-	// 3. update Ambient
+	// analytic form factor from the patch center to the whole plane
+	static double planeFormFactor() {
+		double s = SINGLEPLANE_EXTENT / sqrt(1 + SINGLEPLANE_EXTENT * SINGLEPLANE_EXTENT);
+		return (4 / PI) * s * atan(s);
+	}
 
-	double areaSum = 0;					// Sum of all patch area
-	Color rfltWeightedAreaSum(0, 0, 0);	// Sum of all patch area * patch reflectance
-	for (int p_id = 0; p_id < NumPatches; p_id++) {
-		areaSum += PatchArray[p_id].area;
+	vector<unsigned char> rgb;	// read back scratch
 
-		rfltWeightedAreaSum.r += PatchArray[p_id].area * PatchArray[p_id].reflectance.r;
-		rfltWeightedAreaSum.g += PatchArray[p_id].area * PatchArray[p_id].reflectance.g;
-		rfltWeightedAreaSum.b += PatchArray[p_id].area * PatchArray[p_id].reflectance.b;
+	// a near plane close to the patch, so nothing in front of it is
+	// clipped. the extent is scaled to it, the view keeps its angle
+	void itemBuffer(const SceneStore &store, const ProjectionFrame &frame, int face, const vector<int> &candidates, int32_t* ids) {
+		float e = SINGLEPLANE_EXTENT * SINGLEPLANE_NEAR;
+		renderItemBuffer(store, frame, HEMICUBE_SUBDIV, HEMICUBE_SUBDIV, -e, e, -e, e, SINGLEPLANE_NEAR, SINGLEPLANE_FAR,
+			frame.center + frame.normal, frame.u, candidates, ids, rgb);
 	}
-	// overall interreflection factor R
-	Color R, rfltAvg;
-	rfltAvg.r = rfltWeightedAreaSum.r / areaSum;
-	rfltAvg.g = rfltWeightedAreaSum.g / areaSum;
-	rfltAvg.b = rfltWeightedAreaSum.b / areaSum;
-	R.r = 1 / (1 - rfltAvg.r);
-	R.g = 1 / (1 - rfltAvg.g);
-	R.b = 1 / (1 - rfltAvg.b);
-	// average area of unshot radiosity
-	Color avgUnshot(0, 0, 0);
-	for (int p_id = 0; p_id < NumPatches; p_id++) {
-		avgUnshot.r += PatchArray[p_id].unshot.r * (PatchArray[p_id].area / areaSum);
-		avgUnshot.g += PatchArray[p_id].unshot.g * (PatchArray[p_id].area / areaSum);
-		avgUnshot.b += PatchArray[p_id].unshot.b * (PatchArray[p_id].area / areaSum);
+
+	static double deltaFormFactor(int face, int x, int y) {
+		double pixelSize = 2.0 * SINGLEPLANE_EXTENT / HEMICUBE_SUBDIV;
+		double _x = (x + 0.5) * pixelSize - SINGLEPLANE_EXTENT;
+		double _y = (y + 0.5) * pixelSize - SINGLEPLANE_EXTENT;
+		double r2 = _x*_x + _y*_y + 1;
+		double dArea = pixelSize * pixelSize;
+		return dArea / (PI * r2 * r2) / planeFormFactor();
 	}
+};
 
-	dAmbient = R * avgUnshot;
+typedef ProjectionBuffer<HemicubeProjector> Hemicube;
 
-	// 4. reset things
-	PatchArray[mostUnshotID].unshot = Color(0, 0, 0);	// current patch's unshot <- 0
-	updatePriorityQueue();								// update prioirty queue
 
-														// print current step
-	cout << "-----------------------------------------------------------------" << endl;
-	cout << "\tPR::Current Step " << totalStep++ << endl;
-	cout << "\tPR::Current Unshot Patch: " << PatchArray[mostUnshotID].id << endl;
-	cout << "\tPR::new Ambient factor: " << dAmbient.r << ", " << dAmbient.g << ", " << dAmbient.b << endl;
-}
+//		Functions		//
+
+string checkpointFile 		= "radiosity.ckpt";
+int checkpointInterval 		= 0;		// steps between automatic checkpoints, 0 : off
+string frameLogFile 		= "radiosity.frames";
+int frameLogInterval 		= 0;		// shots between frames, 0 : off
+string formFactorCache 		= "LookUpTable.ffc";
+#define STOCHASTIC_TOLERANCE	0.001	// Monte Carlo runs until this much of the emitted power is left
+#define STOCHASTIC_ITERATIONS	1000	// or this many iterations
 
 // compute form factor of entire scene
 void generateFormFactorTable() {
@@ -428,443 +285,418 @@ void generateFormFactorTable() {
 	cout << "\nGenFormFactors::Start generating patch - element form factors... " << endl;
 	cout << "GenFormFactors::Start time: " << localtime(&timer)->tm_hour << ":" << localtime(&timer)->tm_min << ":" << localtime(&timer)->tm_sec << endl;
 
-	// up vectors for hemicube
-	vec3 up(0, 0, 1);		// towards upper direction of scene
-	vec3 toCam(1, 0, 0);	// towards the camera
-	Hemicube *hemicube;
-
-	// for all patches
-	for (int patch_id = 0; patch_id < NumPatches; patch_id++) {
-
-		cout << "GenFormFactors::computing patch " << patch_id << "/" << NumPatches << "..." << endl;
-
-		// create hemicube for the patch
-		// depends on wall direction.
-		int cosVal = dot(PatchArray[patch_id].normal, up);
-		if (cosVal == 0)
-			hemicube = new Hemicube(PatchArray[patch_id].center, PatchArray[patch_id].normal, up);
-		else
-			hemicube = new Hemicube(PatchArray[patch_id].center, PatchArray[patch_id].normal, toCam);
-
-		for (int element_id = 0; element_id < NumElements; element_id++) {
-			// compute form factor for that element
-			hemicube->computeDeltaFormFactor(ElementArray[element_id], element_id);
-		}
-		// update look up table
-		hemicube->updateLookUpTable(patch_id);
-
-		// delete from memory
-		delete hemicube;
+	solver->shaftCulling = (shaftCulling != 0);
+
+	switch (projectorType) {
+	case PROJ_SINGLEPLANE:
+		cout << "GenFormFactors::projector: single plane" << endl;
+		solver->computeFormFactors<SinglePlaneProjector>();
+		break;
+	case PROJ_HEMISPHERE:
+		cout << "GenFormFactors::projector: hemisphere" << endl;
+		solver->computeFormFactors<HemisphereProjector>();
+		break;
+	default:
+		cout << "GenFormFactors::projector: hemicube" << endl;
+		solver->computeFormFactors<HemicubeProjector>();
+		break;
 	}
 
 	// write file
-
-	ofstream file;
 	string fileName = "LookUpTable_output.csv";
-	file.open(fileName);
-	file << "F/E";
-	for (int id = 0; id < NumElements; id++)	// write first row (element id)
-		file << "," << id;
-	file << endl;
-
-	for (int p_id = 0; p_id < NumPatches; p_id++) {
-		file << p_id;
-		for (int e_id = 0; e_id < NumElements; e_id++) {
-			file << "," << lookUpTable[p_id][e_id];
-		}
-		// move to next line
-		file << endl;
-	}
-	file.close();
+	solver->writeLookUpTable(fileName);
+	solver->packTable(tableStorage);
 
 	timer = time(0);
 	cout << "GenFormFactors::Done. Output file:" << fileName << endl;
 	cout << "GenFormFactors::End time: " << localtime(&timer)->tm_hour << ":" << localtime(&timer)->tm_min << ":" << localtime(&timer)->tm_sec << endl;
 }
 
-// load file "LookUpTable.csv"
-void loadLookUpTable() {
+//		Solver Thread		//
+//
+// progressive refinement runs on its own thread so the window keeps
+// drawing while it converges. the solver publishes colour snapshots
+// through a lock-free triple buffer: it fills the back slot and swaps
+// it with the 'ready' slot, the display swaps 'ready' with its front
+// slot when a new one is flagged. nobody ever waits on a slot.
+//
+// solverMutex guards the solver object.
+// the worker holds it for one step at a time, UI actions that touch the
+// state take it in between.
+
+#define SNAPSHOT_NEW		4	// flag on snapshotReady: not seen by the display yet
+#define SNAPSHOT_INTERVAL_MS	30	// shortest time between two snapshots while running
+
+struct ColorSnapshot {
+	vector<Color> 	vertexColor;		// averaged vertex colours
+	vector<Color> 	elementRadiosity;	// element radiosities, storage order
+	int 		currentPatchID;
+	int 		step;
+};
 
-	cout << "LoadLUTable::start reading file..." << endl;
+ColorSnapshot 		snapshots[3];
+std::atomic<int> 	snapshotReady(2);	// slot index | SNAPSHOT_NEW
+int 			snapshotBack = 1;	// owned by the solver
+int 			snapshotFront = 0;	// owned by the display
+
+std::thread 		solverThread;
+std::mutex 		solverMutex;
+std::condition_variable solverWake;
+int 			stepBudget = 0;		// steps left to run
+bool 			solverQuit = false;
+bool 			stochasticPending = false;	// Monte Carlo solve queued
+bool 			comparePending = false;		// shooting scheme comparison queued
+std::atomic<bool> 	solverBusy(false);	// a long job holds solverMutex, from queueing until done
+bool 			settingsPending = false;	// GLUT thread only: settings wait for the solver
+int 			solverPaused = false;	// guarded by solverMutex
+int 			pauseSolver = false;	// GLUI live variable
+
+// worker copies of GLUI live variables, set from the control callbacks.
+// guarded by solverMutex
+bool 			solverShowAmbient = true;
+int 			solverCheckpointInterval = 0;
+int 			solverFrameLogInterval = 0;
+int 			solverStochasticRays = 0;
+
+// copy colours to the back slot and hand it to the display.
+// call with solverMutex held
+void publishSnapshot(const Color* vertexColor, const Color* elementRadiosity, int currentPatchID, int step) {
+
+	ColorSnapshot &snapshot = snapshots[snapshotBack];
+	snapshot.vertexColor.assign(vertexColor, vertexColor + Store.numVertices);
+	snapshot.elementRadiosity.assign(elementRadiosity, elementRadiosity + Store.numElements);
+	snapshot.currentPatchID = currentPatchID;
+	snapshot.step = step;
+
+	snapshotBack = snapshotReady.exchange(snapshotBack | SNAPSHOT_NEW) & 3;
+}
 
-	ifstream file;
-	double totalSum = 0;
-	file.open("LookUpTable.csv");
+// the solver's current colours
+void publishSnapshot() {
+	publishSnapshot(solver->vertexColor, solver->elementRadiosity, solver->currentPatchID, solver->totalStep);
+}
 
-	// read first line - element id
-	string firstLine;
-	getline(file, firstLine);
-	// read table
-	for (int p_id = 0; p_id < NumPatches; p_id++) {
+// take the newest snapshot, if there is one. display thread only
+bool acquireSnapshot() {
 
-		// read first column of the row (patch id)
-		int id;
-		file >> id;
-		for (int e_id = 0; e_id < NumElements; e_id++) {
-			char comma;
-			file >> comma;
+	if (!(snapshotReady.load() & SNAPSHOT_NEW))
+		return false;
 
-			double val;
-			file >> val;
-			lookUpTable[p_id][e_id] = val;
-			totalSum += val;
-		}
+	snapshotFront = snapshotReady.exchange(snapshotFront) & 3;
+	return true;
+}
+
+// fill every slot with the current state
+void initSnapshots() {
+	for (int i = 0; i < 3; i++) {
+		snapshotBack = i;
+		publishSnapshot();
+	}
+	snapshotBack = 1;
+	snapshotFront = 0;
+	snapshotReady = 2 | SNAPSHOT_NEW;
+}
+
+// table free Monte Carlo solution on the worker thread. it only reads
+// the scene, so the solver is unlocked while it runs; each iteration is
+// published and shown until the solver publishes again.
+// called and returns with 'lock' held
+void runStochastic(std::unique_lock<std::mutex> &lock) {
+
+	int rays = solverStochasticRays * 1000;
+	lock.unlock();
+
+	StochasticSolver stochastic(scene);
+	stochastic.printSteps = true;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int iterations = 0;
+	bool quit = false;
+	while (!quit && iterations < STOCHASTIC_ITERATIONS && stochastic.run(rays, 1, STOCHASTIC_TOLERANCE)) {
+		iterations++;
+		stochastic.updateVertexColor();
+		lock.lock();
+		publishSnapshot(stochastic.vertexColor, stochastic.elementRadiosity, 0, 0);
+		quit = solverQuit;
+		lock.unlock();
 	}
-	file.close();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	cout << "Stochastic::" << iterations << " iterations, " << stochastic.totalRays << " rays on "
+		<< stochastic.numThreads << " threads, " << seconds << " s, relative error " << stochastic.relativeError() << endl;
 
-	cout << "LoadLUTable::total form factor: " << totalSum << endl;
-	cout << "LoadLUTable::file reading done.\n" << endl;
+	lock.lock();
 }
 
-// update vertex color, add amience
-void updateVertexColor() {
+// worker thread body
+void solverLoop() {
 
-	// bilinear interpolation
-	// with neighboring patches
+	std::unique_lock<std::mutex> lock(solverMutex);
+	std::chrono::steady_clock::time_point lastPublish = std::chrono::steady_clock::now();
 
-	struct ColorStack {
-		int count;
-		Color color;
-		ColorStack() : count(0), color(Color(0, 0, 0)) {}
-	};
+	while (true) {
+		solverWake.wait(lock, [] { return solverQuit || stochasticPending || comparePending || (!solverPaused && stepBudget > 0); });
+		if (solverQuit)
+			break;
 
-	ColorStack *colorStack = new ColorStack[NumVertices];
+		if (stochasticPending) {
+			stochasticPending = false;
+			runStochastic(lock);
+			continue;
+		}
+
+		// restores the solution when done, keeps the lock throughout
+		if (comparePending) {
+			comparePending = false;
+			solver->compareShootingSchemes();
+			solverBusy = false;
+			continue;
+		}
 
-	// update vertex radiosity
-	// by each element
-	for (int i = 0; i < NumElements; i++) {
+		solver->step();
+		stepBudget--;
 
-		// add radiosity color
+		// periodic checkpoint
+		if (solverCheckpointInterval > 0 && solver->totalStep % solverCheckpointInterval == 0)
+			solver->saveCheckpoint(checkpointFile);
 
-		if (showAmbient) {
-			colorStack[ElementArray[i].vertices[0]].color += ElementArray[i].radiosity + ElementArray[i].patch->reflectance * dAmbient;
-			colorStack[ElementArray[i].vertices[1]].color += ElementArray[i].radiosity + ElementArray[i].patch->reflectance * dAmbient;
-			colorStack[ElementArray[i].vertices[2]].color += ElementArray[i].radiosity + ElementArray[i].patch->reflectance * dAmbient;
-			colorStack[ElementArray[i].vertices[3]].color += ElementArray[i].radiosity + ElementArray[i].patch->reflectance * dAmbient;
+		// progress stream
+		if (solverFrameLogInterval > 0 && solver->totalStep % solverFrameLogInterval == 0) {
+			if (solver->frameLogOpen() || solver->openFrameLog(frameLogFile))
+				solver->logFrame();
+			else
+				solverFrameLogInterval = 0;	// stays off until the spinner changes
 		}
-		else {
-			colorStack[ElementArray[i].vertices[0]].color += ElementArray[i].radiosity;
-			colorStack[ElementArray[i].vertices[1]].color += ElementArray[i].radiosity;
-			colorStack[ElementArray[i].vertices[2]].color += ElementArray[i].radiosity;
-			colorStack[ElementArray[i].vertices[3]].color += ElementArray[i].radiosity;
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (stepBudget == 0 || now - lastPublish > std::chrono::milliseconds(SNAPSHOT_INTERVAL_MS)) {
+			solver->updateVertexColor(solverShowAmbient);
+			publishSnapshot();
+			lastPublish = now;
 		}
-		// increment count
-		colorStack[ElementArray[i].vertices[0]].count += 1;
-		colorStack[ElementArray[i].vertices[1]].count += 1;
-		colorStack[ElementArray[i].vertices[2]].count += 1;
-		colorStack[ElementArray[i].vertices[3]].count += 1;
-	}
 
-	// average color
-	for (int i = 0; i < NumVertices; i++) {
-		VertexColors[i].r = colorStack[i].color.r / colorStack[i].count;
-		VertexColors[i].g = colorStack[i].color.g / colorStack[i].count;
-		VertexColors[i].b = colorStack[i].color.b / colorStack[i].count;
+		// let waiting UI actions in between steps
+		lock.unlock();
+		std::this_thread::yield();
+		lock.lock();
 	}
-
-	delete colorStack;
-}
-
-// draw patch by id
-void drawPatch(int id) {
-	glColor3f(0, 1, 1);
-	glPointSize(3.f);
-	glBegin(GL_LINE_STRIP);
-	glVertex3f(VertexArray[PatchArray[id].vertices[0]].x, VertexArray[PatchArray[id].vertices[0]].y, VertexArray[PatchArray[id].vertices[0]].z);
-	glVertex3f(VertexArray[PatchArray[id].vertices[1]].x, VertexArray[PatchArray[id].vertices[1]].y, VertexArray[PatchArray[id].vertices[1]].z);
-	glVertex3f(VertexArray[PatchArray[id].vertices[2]].x, VertexArray[PatchArray[id].vertices[2]].y, VertexArray[PatchArray[id].vertices[2]].z);
-	glVertex3f(VertexArray[PatchArray[id].vertices[3]].x, VertexArray[PatchArray[id].vertices[3]].y, VertexArray[PatchArray[id].vertices[3]].z);
-	glVertex3f(VertexArray[PatchArray[id].vertices[0]].x, VertexArray[PatchArray[id].vertices[0]].y, VertexArray[PatchArray[id].vertices[0]].z);
-	glEnd();
 }
 
-// draw element by id
-void drawElement(int id) {
-	glColor3f(1, 0.5, 0.5);
-	glPointSize(2.f);
-	glBegin(GL_QUADS);
-	glVertex3f(VertexArray[ElementArray[id].vertices[0]].x, VertexArray[ElementArray[id].vertices[0]].y, VertexArray[ElementArray[id].vertices[0]].z);
-	glVertex3f(VertexArray[ElementArray[id].vertices[1]].x, VertexArray[ElementArray[id].vertices[1]].y, VertexArray[ElementArray[id].vertices[1]].z);
-	glVertex3f(VertexArray[ElementArray[id].vertices[2]].x, VertexArray[ElementArray[id].vertices[2]].y, VertexArray[ElementArray[id].vertices[2]].z);
-	glVertex3f(VertexArray[ElementArray[id].vertices[3]].x, VertexArray[ElementArray[id].vertices[3]].y, VertexArray[ElementArray[id].vertices[3]].z);
-	glVertex3f(VertexArray[ElementArray[id].vertices[0]].x, VertexArray[ElementArray[id].vertices[0]].y, VertexArray[ElementArray[id].vertices[0]].z);
-	glEnd();
+// take solverMutex for a UI action. while the solver thread runs a
+// job that keeps the mutex, the action is dropped (with a message
+// naming it, if given) instead of freezing the window
+bool lockSolver(std::unique_lock<std::mutex> &lock, const char* action) {
+	if (solverBusy) {
+		if (action)
+			cout << "Solver::busy comparing shooting schemes, " << action << " ignored" << endl;
+		return false;
+	}
+	lock = std::unique_lock<std::mutex>(solverMutex);
+	return true;
 }
 
-// initialize scene : compute initial ambience, init unshot patches
-void initScene(){
+// copy the GLUI settings to the worker side. GLUT thread only; while
+// the solver is busy they are retried from idle()
+void applySettings() {
 
-	// 0. compute some factors...
-
-	Color avgPatchRefl(0, 0, 0); // weighted average of the patch reflectives
-	Color sumEmi(0, 0, 0);		 // weighted sum of emission
-
-	double areaSum = 0;
-	for (int id = 0; id < NumPatches; id++) {
-
-		avgPatchRefl.r += (PatchArray[id].reflectance.r * PatchArray[id].area);
-		avgPatchRefl.g += (PatchArray[id].reflectance.g * PatchArray[id].area);
-		avgPatchRefl.b += (PatchArray[id].reflectance.b * PatchArray[id].area);
-
-		sumEmi.r += (PatchArray[id].emissivity.r * PatchArray[id].area);
-		sumEmi.g += (PatchArray[id].emissivity.g * PatchArray[id].area);
-		sumEmi.b += (PatchArray[id].emissivity.b * PatchArray[id].area);
-
-		areaSum += PatchArray[id].area;
+	std::unique_lock<std::mutex> lock;
+	if (!lockSolver(lock, 0)) {
+		if (!settingsPending)
+			cout << "Solver::busy comparing shooting schemes, settings apply when it is done" << endl;
+		settingsPending = true;
+		return;
 	}
+	settingsPending = false;
+
+	solverPaused = pauseSolver;
+	solver->overshooting = (overshooting != 0);
+	solverCheckpointInterval = checkpointInterval;
+	solverFrameLogInterval = frameLogInterval;
+	if (solverShowAmbient != (showAmbient != 0)) {
+		solverShowAmbient = (showAmbient != 0);
+		solver->updateVertexColor(solverShowAmbient);
+		publishSnapshot();
+	}
+	solverWake.notify_one();
+}
 
+// stop and join the worker, registered with atexit() so it runs
+// before the mutex and condition variable are destroyed
+void stopSolverThread() {
+	{
+		std::lock_guard<std::mutex> lock(solverMutex);
+		solverQuit = true;
+		solverWake.notify_one();
+	}
+	if (solverThread.joinable())
+		solverThread.join();
+}
 
-	// 1. compute reflection factor R
+// flush the frame log and pending checkpoint, registered with atexit()
+// before the solver thread so it runs after the solver has stopped
+void deleteSolver() {
+	delete solver;
+	solver = 0;
+}
 
-	avgPatchRefl.r /= areaSum;
-	avgPatchRefl.g /= areaSum;
-	avgPatchRefl.b /= areaSum;
-	// assign final value
-	reflectionFactor.r = 1 / (1 - avgPatchRefl.r);
-	reflectionFactor.g = 1 / (1 - avgPatchRefl.g);
-	reflectionFactor.b = 1 / (1 - avgPatchRefl.b);
+//		Display Buffers		//
+//
+// the scene is drawn from vertex arrays instead of glBegin / glEnd.
+// positions and the quad index list do not change after loading, so
+// they go to static buffer objects once. vertex colours have a buffer
+// of their own, and only the ranges that differ from the last upload
+// are sent. vertices are numbered in the Morton order of the elements
+// (see Scene::load), so light landing on one part of the scene touches
+// a few long ranges.
+// without buffer objects (GL before 1.5) the same arrays are drawn
+// from client memory.
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER			0x8892
+#define GL_ELEMENT_ARRAY_BUFFER		0x8893
+#define GL_STATIC_DRAW			0x88E4
+#define GL_DYNAMIC_DRAW			0x88E8
+#endif
+#define COLOR_RANGE_GAP			256	// unchanged vertices taken into a range rather than splitting it
+
+typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+typedef void (APIENTRY *BufferSubDataProc)(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void *data);
+
+GenBuffersProc 		genBuffers 	= 0;
+BindBufferProc 		bindBuffer 	= 0;
+BufferDataProc 		bufferData 	= 0;
+BufferSubDataProc 	bufferSubData 	= 0;
+
+bool 		useBufferObjects = false;
+GLuint 		positionBuffer, indexBuffer, colorBuffer;
+vector<Color> 	uploadedColor;		// contents of colorBuffer
+bool 		colorsStale = true;	// a snapshot came in since the last upload
+
+// GL entry point by name, 0 if it can not be looked up
+void* getGLProc(const char* name) {
+#if defined(FREEGLUT)
+	return (void*)glutGetProcAddress(name);
+#elif defined(_WIN32)
+	return (void*)wglGetProcAddress(name);
+#else
+	return 0;
+#endif
+}
 
-	cout << "Init::reflection factor R: " << reflectionFactor.r << ", " << reflectionFactor.g << ", " << reflectionFactor.b << endl;
+// call once the scene is loaded, with the main window's context current
+void initDisplayBuffers() {
+
+	// buffer objects are core in GL 1.5
+	int major = 0, minor = 0;
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (version)
+		sscanf(version, "%d.%d", &major, &minor);
+	if (major > 1 || (major == 1 && minor >= 5)) {
+		genBuffers 	= (GenBuffersProc)getGLProc("glGenBuffers");
+		bindBuffer 	= (BindBufferProc)getGLProc("glBindBuffer");
+		bufferData 	= (BufferDataProc)getGLProc("glBufferData");
+		bufferSubData 	= (BufferSubDataProc)getGLProc("glBufferSubData");
+	}
+	useBufferObjects = genBuffers && bindBuffer && bufferData && bufferSubData;
+
+	if (useBufferObjects) {
+		GLuint buffers[3];
+		genBuffers(3, buffers);
+		positionBuffer 	= buffers[0];
+		indexBuffer 	= buffers[1];
+		colorBuffer 	= buffers[2];
+
+		bindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+		bufferData(GL_ARRAY_BUFFER, Store.numVertices * sizeof(Vertex), Store.vertexPosition, GL_STATIC_DRAW);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		bufferData(GL_ELEMENT_ARRAY_BUFFER, 4 * Store.numElements * sizeof(uint32_t), Store.elementVertices, GL_STATIC_DRAW);
+		bindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+		bufferData(GL_ARRAY_BUFFER, Store.numVertices * sizeof(Color), 0, GL_DYNAMIC_DRAW);
+		bindBuffer(GL_ARRAY_BUFFER, 0);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		// nothing matches, the first update sends everything
+		uploadedColor.assign(Store.numVertices, Color(-1, -1, -1));
+	}
 
+	cout << "Display::" << (version ? version : "no GL version") << ", drawing from "
+		<< (useBufferObjects ? "buffer objects" : "client arrays") << endl;
+}
 
-	// 2. determine initial ambient from given emission
+// send the vertex colours that changed since the last upload
+void updateColorBuffer(const vector<Color> &color) {
 
-	ambient.r = reflectionFactor.r * sumEmi.r / areaSum;
-	ambient.g = reflectionFactor.g * sumEmi.g / areaSum;
-	ambient.b = reflectionFactor.b * sumEmi.b / areaSum;
+	if (!useBufferObjects)
+		return;
 
-	dAmbient.r = 0;
-	dAmbient.g = 0;
-	dAmbient.b = 0;
+	bindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+	int i = 0;
+	while (i < Store.numVertices) {
 
-	cout << "Init::ambient factor: " << ambient.r << ", " << ambient.g << ", " << ambient.b << endl;
+		// 1. next changed vertex
+		while (i < Store.numVertices && color[i] == uploadedColor[i]) i++;
+		if (i == Store.numVertices)
+			break;
 
-	// 3. initialize unshot radiosity with emission value
+		// 2. extend the range until COLOR_RANGE_GAP vertices in a row are unchanged
+		int start = i, end = i + 1, unchanged = 0;
+		for (i++; i < Store.numVertices && unchanged < COLOR_RANGE_GAP; i++) {
+			if (color[i] == uploadedColor[i]) unchanged++;
+			else {
+				unchanged = 0;
+				end = i + 1;
+			}
+		}
 
-	for (int id = 0; id < NumPatches; id++) {
-		PatchArray[id].unshot = PatchArray[id].emissivity;
+		// 3. upload [start, end)
+		std::copy(color.begin() + start, color.begin() + end, uploadedColor.begin() + start);
+		bufferSubData(GL_ARRAY_BUFFER, start * sizeof(Color), (end - start) * sizeof(Color), &color[start]);
 	}
+	bindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-	// 4. initialize look up table
-
-	// patch to element table
-	lookUpTable = new double*[NumPatches];
-	for (int p_id = 0; p_id < NumPatches; p_id++) {
-		lookUpTable[p_id] = new double[NumElements];
-		for (int e_id = 0; e_id < NumElements; e_id++)
-			lookUpTable[p_id][e_id] = 0;		// initialize value
+// every element, coloured by 'color' (one per vertex)
+void drawElements(const vector<Color> &color) {
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	if (useBufferObjects) {
+		bindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+		glVertexPointer(3, GL_FLOAT, 0, 0);
+		bindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+		glColorPointer(3, GL_FLOAT, 0, 0);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glDrawElements(GL_QUADS, 4 * Store.numElements, GL_UNSIGNED_INT, 0);
+		bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		bindBuffer(GL_ARRAY_BUFFER, 0);
 	}
-
-	// 5. update initial heap
-	//	  & initial vertex color
-	updateVertexColor();
-	updatePriorityQueue();
+	else {
+		glVertexPointer(3, GL_FLOAT, 0, Store.vertexPosition);
+		glColorPointer(3, GL_FLOAT, 0, &color[0]);
+		glDrawElements(GL_QUADS, 4 * Store.numElements, GL_UNSIGNED_INT, Store.elementVertices);
+	}
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
 }
 
-int loadData(void) {
-
-	int i, j, k;
-	int nverts, vertnum, startvert;
-	int elnum;
-	Vertex* vtemp;
-	std::ifstream infi("scene.dat");
-	Vector v1;
-	Vector v2;
-	double length1, length2;
-	double temparea;
-
-	NumElements = 0;
-
-	// read initial vertices
-	infi >> nverts;
-	vtemp = new Vertex[nverts];
-	for (i = 0; i<nverts; i++) {
-		infi >> vtemp[i].x >> vtemp[i].y >> vtemp[i].z;
-	}
-	NumVertices = nverts;
-
-	// read patches
-	infi >> NumPatches;
-	PatchArray = new Patch[NumPatches];
-	for (i = 0; i<NumPatches; i++) {
-
-		// Patch id
-		PatchArray[i].id = i;
-
-		// Read patch i
-		infi >> PatchArray[i].vertices[0] >> PatchArray[i].vertices[1]
-			>> PatchArray[i].vertices[2] >> PatchArray[i].vertices[3];
-		infi >> PatchArray[i].emissivity.r >> PatchArray[i].emissivity.g
-			>> PatchArray[i].emissivity.b;
-		infi >> PatchArray[i].reflectance.r >> PatchArray[i].reflectance.g
-			>> PatchArray[i].reflectance.b;
-		infi >> PatchArray[i].numelements;
-
-		// **** TEST : divide more **** //
-		PatchArray[i].numelements += 2;
-
-		if (PatchArray[i].emissivity.r > 0 || PatchArray[i].emissivity.g > 0 || PatchArray[i].emissivity.b > 0){
-			cout << "Load::incident light patch " << i << endl;
-		}
+// one primitive from scene vertices, indices in client memory
+void drawVertices(GLenum mode, int count, const uint32_t* indices) {
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, Store.vertexPosition);
+	glDrawElements(mode, count, GL_UNSIGNED_INT, indices);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
 
-		NumVertices += (PatchArray[i].numelements + 1) *
-			(PatchArray[i].numelements + 1);
-		PatchArray[i].startelement = NumElements;
-		NumElements += (PatchArray[i].numelements * PatchArray[i].numelements);
-
-		// patch center
-		PatchArray[i].center.x = (vtemp[PatchArray[i].vertices[0]].x +
-			vtemp[PatchArray[i].vertices[1]].x +
-			vtemp[PatchArray[i].vertices[2]].x +
-			vtemp[PatchArray[i].vertices[3]].x) / 4.0;
-		PatchArray[i].center.y = (vtemp[PatchArray[i].vertices[0]].y +
-			vtemp[PatchArray[i].vertices[1]].y +
-			vtemp[PatchArray[i].vertices[2]].y +
-			vtemp[PatchArray[i].vertices[3]].y) / 4.0;
-		PatchArray[i].center.z = (vtemp[PatchArray[i].vertices[0]].z +
-			vtemp[PatchArray[i].vertices[1]].z +
-			vtemp[PatchArray[i].vertices[2]].z +
-			vtemp[PatchArray[i].vertices[3]].z) / 4.0;
-
-		// patch area
-		v1.x = vtemp[PatchArray[i].vertices[1]].x -
-			vtemp[PatchArray[i].vertices[0]].x;
-		v1.y = vtemp[PatchArray[i].vertices[1]].y -
-			vtemp[PatchArray[i].vertices[0]].y;
-		v1.z = vtemp[PatchArray[i].vertices[1]].z -
-			vtemp[PatchArray[i].vertices[0]].z;
-		v2.x = vtemp[PatchArray[i].vertices[3]].x -
-			vtemp[PatchArray[i].vertices[0]].x;
-		v2.y = vtemp[PatchArray[i].vertices[3]].y -
-			vtemp[PatchArray[i].vertices[0]].y;
-		v2.z = vtemp[PatchArray[i].vertices[3]].z -
-			vtemp[PatchArray[i].vertices[0]].z;
-		length1 = sqrt(v1.x*v1.x + v1.y*v1.y + v1.z*v1.z);
-		length2 = sqrt(v2.x*v2.x + v2.y*v2.y + v2.z*v2.z);
-		PatchArray[i].area = length1*length2;
-		v1.x /= length1;
-		v1.y /= length1;
-		v1.z /= length1;
-		v2.x /= length2;
-		v2.y /= length2;
-		v2.z /= length2;
-		PatchArray[i].normal.x = v1.y*v2.z - v1.z*v2.y;
-		PatchArray[i].normal.y = v2.x*v1.z - v1.x*v2.z;
-		PatchArray[i].normal.z = v1.x*v2.y - v1.y*v2.x;
-		PatchArray[i].radiosity.r = PatchArray[i].emissivity.r;
-		PatchArray[i].radiosity.g = PatchArray[i].emissivity.g;
-		PatchArray[i].radiosity.b = PatchArray[i].emissivity.b;
-		PatchArray[i].unshot.r = PatchArray[i].emissivity.r;
-		PatchArray[i].unshot.g = PatchArray[i].emissivity.g;
-		PatchArray[i].unshot.b = PatchArray[i].emissivity.b;
-	}
-
-	// create elements (including new vertices)
-	VertexArray = new Vertex[NumVertices];
-	VertexColors = new Color[NumVertices];
-	ElementArray = new Element[NumElements];
-
-	// Copy original (patch) vertices to beginning of array
-	for (i = 0; i<nverts; i++) {
-		VertexArray[i].x = vtemp[i].x;
-		VertexArray[i].y = vtemp[i].y;
-		VertexArray[i].z = vtemp[i].z;
-		VertexColors[i].r = 0.0;
-		VertexColors[i].g = 0.0;
-		VertexColors[i].b = 0.0;
-	}
-
-	// Form Vertices for new elements
-	vertnum = nverts;
-	elnum = 0;
-	for (i = 0; i<NumPatches; i++) {
-		v1.x = (VertexArray[PatchArray[i].vertices[1]].x -
-			VertexArray[PatchArray[i].vertices[0]].x) /
-			PatchArray[i].numelements;
-		v1.y = (VertexArray[PatchArray[i].vertices[1]].y -
-			VertexArray[PatchArray[i].vertices[0]].y) /
-			PatchArray[i].numelements;
-		v1.z = (VertexArray[PatchArray[i].vertices[1]].z -
-			VertexArray[PatchArray[i].vertices[0]].z) /
-			PatchArray[i].numelements;
-		v2.x = (VertexArray[PatchArray[i].vertices[3]].x -
-			VertexArray[PatchArray[i].vertices[0]].x) /
-			PatchArray[i].numelements;
-		v2.y = (VertexArray[PatchArray[i].vertices[3]].y -
-			VertexArray[PatchArray[i].vertices[0]].y) /
-			PatchArray[i].numelements;
-		v2.z = (VertexArray[PatchArray[i].vertices[3]].z -
-			VertexArray[PatchArray[i].vertices[0]].z) /
-			PatchArray[i].numelements;
-
-		startvert = vertnum;
-
-		for (j = 0; j<PatchArray[i].numelements + 1; j++) {
-			for (k = 0; k<PatchArray[i].numelements + 1; k++) {
-				// Create new vertex
-				VertexArray[vertnum].x =
-					VertexArray[PatchArray[i].vertices[0]].x +
-					k * v1.x + j * v2.x;
-				VertexArray[vertnum].y =
-					VertexArray[PatchArray[i].vertices[0]].y +
-					k * v1.y + j * v2.y;
-				VertexArray[vertnum].z =
-					VertexArray[PatchArray[i].vertices[0]].z +
-					k * v1.z + j * v2.z;
-				VertexColors[vertnum].r = 0.0;
-				VertexColors[vertnum].g = 0.0;
-				VertexColors[vertnum].b = 0.0;
-
-				vertnum++;
-			}
-		}
-		temparea = PatchArray[i].area /
-			(PatchArray[i].numelements * PatchArray[i].numelements);
-		// Form Elements for new patch
-		for (j = 0; j<PatchArray[i].numelements; j++) {
-			for (k = 0; k<PatchArray[i].numelements; k++) {
-
-				// Element id
-				ElementArray[elnum].id = elnum;
-
-				// Set vertices
-				ElementArray[elnum].vertices[0] = startvert + k +
-					j * (PatchArray[i].numelements + 1);
-				ElementArray[elnum].vertices[1] = startvert + (k + 1) +
-					j * (PatchArray[i].numelements + 1);
-				ElementArray[elnum].vertices[2] = startvert + (k + 1) +
-					(j + 1) * (PatchArray[i].numelements + 1);
-				ElementArray[elnum].vertices[3] = startvert + k +
-					(j + 1) * (PatchArray[i].numelements + 1);
-
-				// Set center
-				ElementArray[elnum].center.x =
-					(VertexArray[ElementArray[elnum].vertices[0]].x +
-						VertexArray[ElementArray[elnum].vertices[1]].x +
-						VertexArray[ElementArray[elnum].vertices[2]].x +
-						VertexArray[ElementArray[elnum].vertices[3]].x) / 4.0;
-				ElementArray[elnum].center.y =
-					(VertexArray[ElementArray[elnum].vertices[0]].y +
-						VertexArray[ElementArray[elnum].vertices[1]].y +
-						VertexArray[ElementArray[elnum].vertices[2]].y +
-						VertexArray[ElementArray[elnum].vertices[3]].y) / 4.0;
-				ElementArray[elnum].center.z =
-					(VertexArray[ElementArray[elnum].vertices[0]].z +
-						VertexArray[ElementArray[elnum].vertices[1]].z +
-						VertexArray[ElementArray[elnum].vertices[2]].z +
-						VertexArray[ElementArray[elnum].vertices[3]].z) / 4.0;
-
-				ElementArray[elnum].area = temparea;
-				ElementArray[elnum].patch = &PatchArray[i];
-				ElementArray[elnum].radiosity = PatchArray[i].radiosity;
-				elnum++;
-			}
-		}
-	}
+// draw patch by id
+void drawPatch(int id) {
+	glColor3f(0, 1, 1);
+	drawVertices(GL_LINE_LOOP, 4, &Store.patchVertices[4 * id]);
+}
 
-	delete[] vtemp;
-	infi.close();
-	return 0;
+// draw element by id
+void drawElement(int id) {
+	glColor3f(1, 0.5, 0.5);
+	drawVertices(GL_QUADS, 4, &Store.elementVertices[4 * id]);
 }
 
 // initialize entire scene
@@ -874,9 +706,19 @@ void init(void) {
 
 	glClearColor(0.0, 0.0, 0.0, 0.0);
 	glEnable(GL_DEPTH_TEST);
-	loadData();		// load scene data
-	initScene();	// init initial scene factors
-	loadLookUpTable();
+	scene.printSteps = true;
+	if (!scene.load("scene.dat", extraSubdivision))	// load scene data
+		exit(1);
+	initDisplayBuffers();				// static vertex and index buffers
+	solver = new Solver(scene);			// init initial scene factors
+	solver->printSteps = true;
+	if (!solver->loadFormFactorCache(formFactorCache))		// packed copy, if there is one
+		solver->loadLookUpTable("LookUpTable.csv");
+	tableStorage = solver->tableFormat;
+
+	Color R = solver->reflectionFactor, ambient = solver->ambient;
+	cout << "Init::reflection factor R: " << R.r << ", " << R.g << ", " << R.b << endl;
+	cout << "Init::ambient factor: " << ambient.r << ", " << ambient.g << ", " << ambient.b << endl;
 
 	cout << "\n\tInitialization Complete\n" << endl;
 	cout << "----------------------------------------" << endl;
@@ -884,12 +726,18 @@ void init(void) {
 
 // GLUT display
 void display(void) {
-	int i;
+
+	// newest colours published by the solver thread
+	const ColorSnapshot &snapshot = snapshots[snapshotFront];
+	if (colorsStale) {
+		updateColorBuffer(snapshot.vertexColor);
+		colorsStale = false;
+	}
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	if (displayCurrentShotPatch)
-		drawPatch(currentPatchID);
+		drawPatch(snapshot.currentPatchID);
 
 	glEnable(GL_FLAT | GL_SMOOTH);
 	if (smoothShade)
@@ -897,38 +745,23 @@ void display(void) {
 	else
 		glShadeModel(GL_FLAT);
 
-	glBegin(GL_QUADS);
-	for (i = 0; i<NumElements; i++) {
-
-		glColor3f(VertexColors[ElementArray[i].vertices[0]].r,
-			VertexColors[ElementArray[i].vertices[0]].g,
-			VertexColors[ElementArray[i].vertices[0]].b);
-		glVertex3f(VertexArray[ElementArray[i].vertices[0]].x,
-			VertexArray[ElementArray[i].vertices[0]].y,
-			VertexArray[ElementArray[i].vertices[0]].z);
-		glColor3f(VertexColors[ElementArray[i].vertices[1]].r,
-			VertexColors[ElementArray[i].vertices[1]].g,
-			VertexColors[ElementArray[i].vertices[1]].b);
-		glVertex3f(VertexArray[ElementArray[i].vertices[1]].x,
-			VertexArray[ElementArray[i].vertices[1]].y,
-			VertexArray[ElementArray[i].vertices[1]].z);
-		glColor3f(VertexColors[ElementArray[i].vertices[2]].r,
-			VertexColors[ElementArray[i].vertices[2]].g,
-			VertexColors[ElementArray[i].vertices[2]].b);
-		glVertex3f(VertexArray[ElementArray[i].vertices[2]].x,
-			VertexArray[ElementArray[i].vertices[2]].y,
-			VertexArray[ElementArray[i].vertices[2]].z);
-		glColor3f(VertexColors[ElementArray[i].vertices[3]].r,
-			VertexColors[ElementArray[i].vertices[3]].g,
-			VertexColors[ElementArray[i].vertices[3]].b);
-		glVertex3f(VertexArray[ElementArray[i].vertices[3]].x,
-			VertexArray[ElementArray[i].vertices[3]].y,
-			VertexArray[ElementArray[i].vertices[3]].z);
-	}
-	glEnd();
+	drawElements(snapshot.vertexColor);
 	glFlush();
 }
 
+// GLUT idle : pick up new solver results
+void idle(void) {
+	if (settingsPending)
+		applySettings();
+	if (acquireSnapshot()) {
+		colorsStale = true;
+		glutSetWindow(mainWindow);
+		glutPostRedisplay();
+	}
+	else
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
 // GLUT reshape
 void reshape(int w, int h) {
 	
@@ -945,16 +778,62 @@ void reshape(int w, int h) {
 
 void buttonCallback(GLUI_Control* control) {
 
-	if (control->get_id() == BTN_RUNPR) {
-		for (int i = 0; i < numOfIteration; i++) {
-			progressiveRefinement();
-		}
-		updateVertexColor();
-		glutPostRedisplay();
+	std::unique_lock<std::mutex> lock;
+
+	if (control->get_id() == CB_PAUSE_ID || control->get_id() == CB_AMBIENT_ID || control->get_id() == CB_OVERSHOOT_ID
+		|| control->get_id() == SPIN_CHECKPOINT_ID || control->get_id() == SPIN_FRAMELOG_ID) {
+		applySettings();
+	}
+	else if (control->get_id() == BTN_RUNPR) {
+		// queue steps for the solver thread
+		if (!lockSolver(lock, "run")) return;
+		stepBudget += numOfIteration;
+		solverWake.notify_one();
+	}
+	else if (control->get_id() == BTN_CANCELPR) {
+		if (!lockSolver(lock, "cancel")) return;
+		stepBudget = 0;
+	}
+	else if (control->get_id() == BTN_COMPARE) {
+		// queue the comparison for the solver thread
+		if (!lockSolver(lock, "compare")) return;
+		comparePending = true;
+		solverBusy = true;
+		solverWake.notify_one();
+	}
+	else if (control->get_id() == BTN_STOCHASTIC) {
+		// queue a Monte Carlo solve for the solver thread
+		if (!lockSolver(lock, "stochastic solve")) return;
+		solverStochasticRays = stochasticRays;
+		stochasticPending = true;
+		solverWake.notify_one();
 	}
 	else if (control->get_id() == BTN_GENFF) {
+		if (!lockSolver(lock, "form factor generation")) return;
 		generateFormFactorTable();		// compute form factors
 	}
+	else if (control->get_id() == RB_TABLE_ID) {
+		if (!lockSolver(lock, "table storage change")) {
+			radio_table->set_int_val(solver->tableFormat);	// only changed on this thread
+			return;
+		}
+		solver->packTable(tableStorage);
+	}
+	else if (control->get_id() == BTN_SAVECACHE) {
+		if (!lockSolver(lock, "save table cache")) return;
+		solver->saveFormFactorCache(formFactorCache);
+	}
+	else if (control->get_id() == BTN_SAVECKPT) {
+		if (!lockSolver(lock, "save checkpoint")) return;
+		solver->saveCheckpoint(checkpointFile);
+	}
+	else if (control->get_id() == BTN_LOADCKPT) {
+		if (!lockSolver(lock, "load checkpoint")) return;
+		if (solver->loadCheckpoint(checkpointFile)) {
+			solver->updateVertexColor(solverShowAmbient);
+			publishSnapshot();
+		}
+	}
 }
 
 int main(int argc, char** argv)
@@ -962,6 +841,12 @@ int main(int argc, char** argv)
 	cout << "Project3 - Computer Graphics, Fall 2017, Texas A&M University" << endl;
 	cout << "Made by Somyung (David) Oh.\n" << endl;
 
+	// command line
+	for (int i = 1; i < argc - 1; i++) {
+		if (string(argv[i]) == "-subdiv")
+			extraSubdivision = atoi(argv[++i]);
+	}
+
 	// GLUT initialization
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
@@ -972,6 +857,16 @@ int main(int argc, char** argv)
 	glutDisplayFunc(display);
 	glutReshapeFunc(reshape);
 
+	// start solver thread
+	solverShowAmbient 		= (showAmbient != 0);
+	solver->overshooting 		= (overshooting != 0);
+	solverCheckpointInterval 	= checkpointInterval;
+	solverFrameLogInterval 		= frameLogInterval;
+	initSnapshots();
+	atexit(deleteSolver);
+	solverThread = std::thread(solverLoop);
+	atexit(stopSolverThread);
+
 	// GLUI initialization
 	glui = GLUI_Master.create_glui("Render Control", 0, 800, 70);
 	panel_control 		= new  GLUI_Panel(glui, "Settings");
@@ -981,10 +876,41 @@ int main(int argc, char** argv)
 	spinner_iterationLevel 	= new GLUI_Spinner(panel_control, "interation in step", &numOfIteration, -1, buttonCallback);
 	spinner_iterationLevel->set_int_limits(1, 150, GLUI_LIMIT_CLAMP);
 	spinner_iterationLevel->set_speed(0.05);
+	cbox_pause 		= new GLUI_Checkbox(panel_control, "pause solver", &pauseSolver, CB_PAUSE_ID, buttonCallback);
+	cbox_overshoot 		= new GLUI_Checkbox(panel_control, "overshooting", &overshooting, CB_OVERSHOOT_ID, buttonCallback);
 	button_doPR 		= new GLUI_Button(glui, "Do Progressive Refinement", BTN_RUNPR, buttonCallback);
+	button_cancelPR 	= new GLUI_Button(glui, "Cancel Remaining Steps", BTN_CANCELPR, buttonCallback);
+	button_compare 		= new GLUI_Button(glui, "Compare Shooting Schemes", BTN_COMPARE, buttonCallback);
 	glui->add_separator();
+	panel_projector 	= new GLUI_Panel(glui, "Form Factor Projector");
+	radio_projector 	= new GLUI_RadioGroup(panel_projector, &projectorType);
+	new GLUI_RadioButton(radio_projector, "hemicube");
+	new GLUI_RadioButton(radio_projector, "single plane");
+	new GLUI_RadioButton(radio_projector, "hemisphere");
+	cbox_shaftCulling 	= new GLUI_Checkbox(panel_projector, "shaft culling", &shaftCulling);
 	button_genFF 		= new GLUI_Button(glui, "Generate Form Factor", BTN_GENFF, buttonCallback);
+	panel_table 		= new GLUI_Panel(glui, "Form Factor Storage");
+	radio_table 		= new GLUI_RadioGroup(panel_table, &tableStorage, RB_TABLE_ID, buttonCallback);
+	new GLUI_RadioButton(radio_table, "double");
+	new GLUI_RadioButton(radio_table, "fp16");
+	new GLUI_RadioButton(radio_table, "log 16-bit");
+	new GLUI_RadioButton(radio_table, "log 8-bit");
+	button_saveCache 	= new GLUI_Button(panel_table, "Save Table Cache", BTN_SAVECACHE, buttonCallback);
+	glui->add_separator();
+	panel_stochastic 	= new GLUI_Panel(glui, "Monte Carlo (no table)");
+	spinner_stochasticRays 	= new GLUI_Spinner(panel_stochastic, "k rays per iteration", &stochasticRays, -1, buttonCallback);
+	spinner_stochasticRays->set_int_limits(10, 100000, GLUI_LIMIT_CLAMP);
+	button_stochastic 	= new GLUI_Button(panel_stochastic, "Stochastic Solve", BTN_STOCHASTIC, buttonCallback);
+	glui->add_separator();
+	panel_checkpoint 	= new GLUI_Panel(glui, "Checkpoint");
+	spinner_checkpoint 	= new GLUI_Spinner(panel_checkpoint, "save every (steps)", &checkpointInterval, SPIN_CHECKPOINT_ID, buttonCallback);
+	spinner_checkpoint->set_int_limits(0, 10000, GLUI_LIMIT_CLAMP);
+	button_saveCkpt 	= new GLUI_Button(panel_checkpoint, "Save Checkpoint", BTN_SAVECKPT, buttonCallback);
+	button_loadCkpt 	= new GLUI_Button(panel_checkpoint, "Load Checkpoint", BTN_LOADCKPT, buttonCallback);
+	spinner_frameLog 	= new GLUI_Spinner(panel_checkpoint, "log frame every (shots)", &frameLogInterval, SPIN_FRAMELOG_ID, buttonCallback);
+	spinner_frameLog->set_int_limits(0, 10000, GLUI_LIMIT_CLAMP);
 	glui->set_main_gfx_window(mainWindow);
+	GLUI_Master.set_glutIdleFunc(idle);
 
 	glutMainLoop();
 